@@ -13,6 +13,15 @@
  *    This will contain the class definition of:
  *        BST                 : A class that represents a binary search tree
  *        BST::iterator       : An iterator through BST
+ *        BST::node_type      : A node extracted from a BST
+ *        BSTNode             : One node of a BST (BST::BNode)
+ *        EmptyBase           : Holds a comparator or allocator in no room
+ *        KeyCompare          : Holds the comparator a BST orders by
+ *        SlabPool            : The slabs a PoolAllocator and its copies share
+ *        PoolAllocator       : Hands out tree nodes from large slabs
+ *        WorkerPool          : The threads a BST spreads its work over
+ *        NodeCount           : Subtree size kept in an order-statistics BST
+ *        FrozenBST           : A read-only snapshot of a BST in one array
  * Author
  *    Stephen Costigan, Alexander Dohms, Jonathan Colwell, Shaun Crook
  ************************************************************************/
@@ -28,28 +37,533 @@
 #include <cassert>
 #include <iostream>
 #include <utility>
-#include <memory>     // for std::allocator
+#include <memory>     // for std::allocator and std::allocator_traits
 #include <functional> // for std::less
 #include <utility>    // for std::pair
+#include <type_traits> // for std::is_class and std::is_final
+#include <iterator>   // for std::iterator_traits and std::distance
+#include <algorithm>  // for std::is_sorted and std::stable_sort
+#include <vector>     // for std::vector
+#include <thread>     // for std::thread
+#include <mutex>      // for std::mutex
+#include <condition_variable> // for std::condition_variable
+#include <deque>      // for std::deque
+#include <exception>  // for std::exception_ptr
+#include <atomic>     // for std::atomic
+#include <cstddef>    // for std::max_align_t
+#include <new>        // for placement new
+
+// a hint to start loading the cache line at p; it never faults
+#if defined(__GNUC__) || defined(__clang__)
+#define BST_PREFETCH(p) __builtin_prefetch(p)
+#elif defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+#include <xmmintrin.h>
+#define BST_PREFETCH(p) _mm_prefetch(reinterpret_cast<const char *>(p), _MM_HINT_T0)
+#else
+#define BST_PREFETCH(p) ((void)0)
+#endif
 
 namespace custom
 {
 
 /*****************************************************************
- * BINARY SEARCH TREE
- * Create a Binary Search Tree
+ * EMPTY BASE
+ * Holds one object that is usually stateless, such as a comparator
+ * or an allocator. The owner inherits from this so that an empty
+ * object takes up no room at all (the empty base optimization).
+ * Function pointers and final classes cannot be inherited from, so
+ * those are kept as a member instead.
+ *****************************************************************/
+template <typename T, bool isEmptyBase = std::is_class<T>::value && !std::is_final<T>::value>
+class EmptyBase : private T
+{
+public:
+   EmptyBase() : T() {}
+   EmptyBase(const T & t) : T(t) {}
+   EmptyBase(T && t) : T(std::move(t)) {}
+
+   T       & get()       { return *this; }
+   const T & get() const { return *this; }
+};
+
+template <typename T>
+class EmptyBase <T, false>
+{
+public:
+   EmptyBase() : value() {}
+   EmptyBase(const T & t) : value(t) {}
+   EmptyBase(T && t) : value(std::move(t)) {}
+
+   T       & get()       { return value; }
+   const T & get() const { return value; }
+
+private:
+   T value;
+};
+
+/*****************************************************************
+ * KEY COMPARE
+ * Holds the comparator for a BST in an EMPTY BASE, so a stateless
+ * comparator such as std::less takes up no room at all.
+ *****************************************************************/
+template <typename Compare>
+class KeyCompare : private EmptyBase <Compare>
+{
+public:
+   KeyCompare(const Compare & comp) : EmptyBase<Compare>(comp) {}
+
+   const Compare & key_comp() const { return this->get(); }
+
+   template <typename A, typename B>
+   bool isLess(const A & lhs, const B & rhs) const { return this->get()(lhs, rhs); }
+
+   void swapCompare(KeyCompare & rhs)
+   {
+      using std::swap;
+      swap(this->get(), rhs.get());
+   }
+};
+
+/*****************************************************************
+ * SLAB POOL
+ * The memory behind a PoolAllocator and every copy of it. Blocks
+ * are carved out of 64KB slabs, one free list per block size (a
+ * rebound copy asks for a different size), and everything goes
+ * back to the heap when the last allocator sharing the pool lets
+ * go. Only the count of sharers is safe to touch from several
+ * threads; blocks may be taken and given back by one at a time.
+ *****************************************************************/
+class SlabPool
+{
+public:
+   SlabPool() noexcept : numRefs(1), pSlabs(nullptr), pBuckets(nullptr) {}
+   ~SlabPool();
+   SlabPool(const SlabPool &) = delete;
+   SlabPool & operator = (const SlabPool &) = delete;
+
+   void * allocate  (size_t size, size_t align);
+   void   deallocate(void * p, size_t size, size_t align) noexcept;
+   void   release() noexcept;
+
+   std::atomic<size_t> numRefs;   // allocators sharing this pool
+
+private:
+   enum { SLAB_SIZE = 65536 };
+
+   // a free block holds the free list link
+   struct Block
+   {
+      Block * pNextFree;
+   };
+
+   // the blocks of one size, from whichever slabs they were cut
+   struct Bucket
+   {
+      size_t   size;
+      Block  * pFree;          // blocks given back to us
+      char   * pNext;          // next never-used block in the newest slab
+      char   * pEnd;           // end of the newest slab
+      Bucket * pNextBucket;
+   };
+
+   // the slabs are chained together so they can all be freed
+   struct Slab
+   {
+      Slab * pNextSlab;
+   };
+
+   static size_t blockSize(size_t size, size_t align);
+   static size_t slabHeader() { return (sizeof(Slab) + alignof(std::max_align_t) - 1) / alignof(std::max_align_t) * alignof(std::max_align_t); }
+   Bucket * findBucket(size_t size);
+
+   Slab   * pSlabs;            // every slab we own
+   Bucket * pBuckets;          // one for each block size asked for
+};
+
+/*****************************************************************
+ * POOL ALLOCATOR
+ * An allocator for tree nodes. Nodes are carved out of large slabs
+ * and freed nodes go on an intrusive free list to be handed out
+ * again, so inserting and erasing rarely reaches the global heap.
+ * Copies, moves and rebinds share one SlabPool and compare equal,
+ * so any of them can free what another allocated and nodes can
+ * move between trees built on the same pool. Two pools made
+ * separately never compare equal, and nodes cannot change hands
+ * between them: a BST moves such values into nodes of its own.
+ * release() frees every slab at once, which BST::clear() uses
+ * instead of giving nodes back one at a time, but only while
+ * canRelease() says nothing else can be holding any of them.
  *****************************************************************/
 template <typename T>
-class BST
+class PoolAllocator
+{
+public:
+   typedef T value_type;
+   typedef std::false_type propagate_on_container_copy_assignment;
+   typedef std::true_type  propagate_on_container_move_assignment;
+   typedef std::true_type  propagate_on_container_swap;
+   typedef std::false_type is_always_equal;
+
+   template <typename U>
+   struct rebind { typedef PoolAllocator<U> other; };
+
+   //
+   // Construct
+   //
+   PoolAllocator() : pPool(new SlabPool) {}
+   PoolAllocator(const PoolAllocator & rhs) noexcept : pPool(rhs.pPool) { pPool->numRefs++; }
+   template <typename U>
+   PoolAllocator(const PoolAllocator<U> & rhs) noexcept : pPool(rhs.pPool) { pPool->numRefs++; }
+   ~PoolAllocator() { drop(); }
+
+   //
+   // Assign
+   //
+   PoolAllocator & operator = (const PoolAllocator & rhs) noexcept
+   {
+      rhs.pPool->numRefs++;
+      drop();
+      pPool = rhs.pPool;
+      return *this;
+   }
+   friend void swap(PoolAllocator & lhs, PoolAllocator & rhs) noexcept
+   {
+      std::swap(lhs.pPool, rhs.pPool);
+   }
+
+   //
+   // Allocate
+   //
+   T *  allocate  (size_t n);
+   void deallocate(T * p, size_t n) noexcept;
+   bool canRelease() const noexcept { return pPool->numRefs == 1; }
+   void release() noexcept { pPool->release(); }
+
+   // memory from one pool can go back through any copy of it
+   template <typename U>
+   bool operator == (const PoolAllocator<U> & rhs) const noexcept { return pPool == rhs.pPool; }
+   template <typename U>
+   bool operator != (const PoolAllocator<U> & rhs) const noexcept { return pPool != rhs.pPool; }
+
+private:
+   template <typename U>
+   friend class PoolAllocator;
+
+   void drop() noexcept
+   {
+      if (--pPool->numRefs == 0)
+         delete pPool;
+   }
+
+   SlabPool * pPool;           // shared with every copy
+};
+
+/*****************************************************************
+ * WORKER POOL
+ * The threads a BST spreads its work over. They are started the
+ * first time there is work for them and then kept for every call
+ * after, so splitting work in two costs a queued task rather than
+ * a new thread. Work is queued in a Group and the group is waited
+ * on as one; a thread waiting on a group runs queued tasks itself
+ * until the group is done, so work may wait on work it queued
+ * without tying up every thread.
+ *****************************************************************/
+class WorkerPool
+{
+public:
+   // tasks waited on together
+   class Group
+   {
+   public:
+      Group() : pool(WorkerPool::instance()), numLeft(0) {}
+      ~Group() { pool.finish(*this); }
+      Group(const Group &) = delete;
+      Group & operator = (const Group &) = delete;
+
+      template <typename Work>
+      void run(Work work);     // on any thread, this one if it cannot be queued
+      template <typename Work>
+      void call(Work work);    // on this thread, now
+      void wait();             // for all of it, then throw what it threw first
+
+   private:
+      friend class WorkerPool;
+      void fail(std::exception_ptr pFailed);
+
+      WorkerPool & pool;
+      size_t numLeft;              // queued or running, under the pool's lock
+      std::exception_ptr pError;   // the first exception, under the pool's lock
+   };
+
+   static WorkerPool & instance();
+
+private:
+   struct Task
+   {
+      Group * pGroup;
+      std::function<void()> work;
+   };
+
+   WorkerPool();
+   ~WorkerPool();
+   void serve();
+   void runTask(std::unique_lock<std::mutex> & lock);
+   void finish(Group & group) noexcept;
+
+   std::mutex mutex;
+   std::condition_variable isChanged;   // a task was queued or finished
+   std::deque<Task> tasks;
+   std::vector<std::thread> threads;
+   bool isStopping;
+};
+
+/*****************************************************************
+ * NODE COUNT
+ * How many nodes are in the subtree a BST node heads, itself
+ * included. Only an order-statistics BST (isCounted) stores it;
+ * otherwise this is an empty base and every update compiles away.
+ *****************************************************************/
+template <bool isCounted>
+class NodeCount
+{
+public:
+   size_t getCount() const { return 0; }
+   void   setCount(size_t) { }
+};
+
+template <>
+class NodeCount <true>
+{
+public:
+   NodeCount() : count(1) {}
+   size_t getCount() const { return count; }
+   void   setCount(size_t num) { count = num; }
+
+private:
+   size_t count;
+};
+
+/*****************************************************************
+ * FROZEN BST
+ * A read-only copy of a sorted sequence laid out for searching
+ * (BST::freeze() makes one). The elements sit in one array in
+ * breadth-first (Eytzinger) order: slot k's children are slots 2k
+ * and 2k + 1, counting from 1. A search is one comparison per level
+ * with no branch on its result, and the first few levels, which every
+ * search visits, share a handful of cache lines. Slot 0 means end()
+ *****************************************************************/
+template <typename T, typename Compare = std::less<T>>
+class FrozenBST : private KeyCompare <Compare>
+{
+public:
+   class iterator;
+   typedef iterator const_iterator;
+
+   //
+   // Construct - from a range already sorted by comp
+   //
+   explicit FrozenBST(const Compare & comp = Compare()) : KeyCompare<Compare>(comp) {}
+   template <typename ForwardIt, typename = typename std::iterator_traits<ForwardIt>::iterator_category>
+   FrozenBST(ForwardIt first, ForwardIt last, const Compare & comp = Compare());
+
+   //
+   // Access
+   //
+   iterator find(const T & t) const;
+   iterator lower_bound(const T & t) const { return iterator(lowerBound(t), this); }
+   iterator upper_bound(const T & t) const { return iterator(upperBound(t), this); }
+   template <typename K, typename C = Compare, typename = typename C::is_transparent>
+   iterator find(const K & k) const;
+   template <typename K, typename C = Compare, typename = typename C::is_transparent>
+   iterator lower_bound(const K & k) const { return iterator(lowerBound(k), this); }
+   template <typename K, typename C = Compare, typename = typename C::is_transparent>
+   iterator upper_bound(const K & k) const { return iterator(upperBound(k), this); }
+
+   //
+   // Iterator - in order
+   //
+   iterator begin() const { return iterator(firstSlot(keys.size()), this); }
+   iterator end()   const { return iterator(0, this); }
+
+   //
+   // Status
+   //
+   bool   empty() const noexcept { return keys.empty(); }
+   size_t size()  const noexcept { return keys.size();  }
+   using KeyCompare<Compare>::key_comp;
+
+#ifdef DEBUG // make this visible to the unit tests
+public:
+#else
+private:
+#endif
+
+   // how far ahead to prefetch: the slots 2^d levels below slot k start
+   // at k * 2^d and sit side by side, so one cache line holds them all
+   static constexpr size_t prefetchAhead(size_t num = 1)
+      { return (num * 2 * sizeof(T) > 64) ? num : prefetchAhead(num * 2); }
+
+   template <typename K>
+   size_t lowerBound(const K & k) const;
+   template <typename K>
+   size_t upperBound(const K & k) const;
+   static unsigned trailingOnes(size_t k);
+   static size_t firstSlot(size_t num);
+   static size_t lastSlot (size_t num);
+   static size_t nextSlot (size_t k, size_t num);
+   static size_t prevSlot (size_t k, size_t num);
+
+   std::vector<T> keys;       // slot k lives in keys[k - 1]
+};
+
+/**********************************************************
+ * FROZEN BST ITERATOR
+ * In-order walk over the slots of a FrozenBST
+ *********************************************************/
+template <typename T, typename Compare>
+class FrozenBST <T, Compare> :: iterator
+{
+public:
+   typedef std::bidirectional_iterator_tag iterator_category;
+   typedef T              value_type;
+   typedef std::ptrdiff_t difference_type;
+   typedef const T *      pointer;
+   typedef const T &      reference;
+
+   iterator(size_t k = 0, const FrozenBST * pTree = nullptr) : slot(k), pTree(pTree) { }
+
+   bool operator != (const iterator & rhs) const { return slot != rhs.slot; }
+   bool operator == (const iterator & rhs) const { return slot == rhs.slot; }
+   const T & operator * () const { return pTree->keys[slot - 1]; }
+
+   iterator & operator ++ ()
+   {
+      slot = nextSlot(slot, pTree->keys.size());
+      return *this;
+   }
+   iterator   operator ++ (int postfix)
+   {
+      iterator it = *this;
+      ++(*this);
+      return it;
+   }
+   iterator & operator -- ()
+   {
+      slot = slot ? prevSlot(slot, pTree->keys.size()) : lastSlot(pTree->keys.size());
+      return *this;
+   }
+   iterator   operator -- (int postfix)
+   {
+      iterator it = *this;
+      --(*this);
+      return it;
+   }
+
+#ifdef DEBUG // make this visible to the unit tests
+public:
+#else
+private:
+#endif
+
+   size_t slot;               // 0 is end()
+   const FrozenBST * pTree;
+};
+
+/*****************************************************************
+ * BINARY NODE
+ * A single node in a binary tree. Note that the node does not know
+ * anything about the properties of the tree so no validation can be done.
+ * A BST knows it as BST::BNode.
+ *****************************************************************/
+template <typename T, bool isCounted>
+class BSTNode : public NodeCount <isCounted>
+{
+public:
+   // 
+   // Construct
+   //
+    BSTNode() : pLeft(nullptr), pRight(nullptr), pParent(nullptr), data(T()) { isRed = true; }				// Default Constructor
+    BSTNode(const T& t) : pParent(nullptr), pLeft(nullptr), pRight(nullptr), data(t) { isRed = true; }		// Copy Constructor
+    BSTNode(T&& t) : pParent(nullptr), pLeft(nullptr), pRight(nullptr), data(std::move(t)) { isRed = true; }	// Move Constructor
+    struct InPlace {};
+    template <typename ... Args>
+    BSTNode(InPlace, Args&& ... args)                                                                          // Emplace Constructor
+       : data(std::forward<Args>(args)...), pLeft(nullptr), pRight(nullptr), pParent(nullptr), isRed(true) {}
+
+   //
+   // Insert
+   //
+   void addLeft (BSTNode * pNode);
+   void addRight(BSTNode * pNode);
+   
+
+   // 
+   // Status
+   //
+   bool isRightChild() const { return pParent && pParent->pRight == this; } // by position, not by value,
+   bool isLeftChild () const { return pParent && pParent->pLeft  == this; } // so duplicates work too
+   static bool isBlack(const BSTNode* pNode) { return pNode == nullptr || !pNode->isRed; } // null leaves are black
+   static size_t countOf(const BSTNode* pNode) { return pNode ? pNode->getCount() : 0; }   // null leaves are empty
+   void recount() { this->setCount(1 + countOf(pLeft) + countOf(pRight)); }
+
+   //
+   // Navigate
+   //
+   static BSTNode * first(BSTNode * pNode);     // left-most node below pNode
+   static BSTNode * last (BSTNode * pNode);     // right-most node below pNode
+   static BSTNode * next (BSTNode * pNode);     // in-order successor, nullptr after the end
+   static BSTNode * prev (BSTNode * pNode);     // in-order predecessor, nullptr before the start
+
+   //
+   // Data
+   //
+   T data;                  // Actual data stored in the BSTNode
+   BSTNode* pLeft;            // Left child - smaller
+   BSTNode* pRight;           // Right child - larger
+   BSTNode* pParent;          // Parent
+   bool isRed;              // Red-black balancing stuff
+};
+
+/*****************************************************************
+ * BINARY SEARCH TREE
+ * Create a Binary Search Tree. With isCounted set, every node
+ * also knows the size of its subtree, which makes select(), rank()
+ * and advance() O(log n) at the cost of one size_t per node
+ *****************************************************************/
+template <typename T, typename Compare = std::less<T>, typename Allocator = std::allocator<T>, bool isCounted = false>
+class BST : private KeyCompare <Compare>,
+            private EmptyBase <typename std::allocator_traits<Allocator>::template rebind_alloc<BSTNode<T, isCounted>>>
 {
 public:
+   typedef Allocator allocator_type;
+
    //
    // Construct - Finished | Alexander
    //
-    BST() : root(nullptr), numElements(0) {}                                                                          //Default Constructor
-    BST(const BST& rhs) : root(nullptr), numElements(0) { *this = rhs; }                                              //Copy constructor 
-    BST(BST&& rhs) : root(rhs.root), numElements(rhs.numElements) { rhs.root = nullptr; rhs.numElements = 0; }        //Move Constructor
-    BST(const std::initializer_list<T>& il) : root(nullptr), numElements(0) { *this = il; }                           //Initializer List Constructor
+    BST() : KeyCompare<Compare>(Compare()), EmptyBase<NodeAllocator>(), root(nullptr), pFirst(nullptr), pLast(nullptr), numElements(0) {}            //Default Constructor
+    explicit BST(const Compare& comp, const Allocator& alloc = Allocator())
+       : KeyCompare<Compare>(comp), EmptyBase<NodeAllocator>(alloc), root(nullptr), pFirst(nullptr), pLast(nullptr), numElements(0) {}               //Comparator Constructor
+    explicit BST(const Allocator& alloc)
+       : KeyCompare<Compare>(Compare()), EmptyBase<NodeAllocator>(alloc), root(nullptr), pFirst(nullptr), pLast(nullptr), numElements(0) {}          //Allocator Constructor
+    BST(const BST& rhs)
+       : KeyCompare<Compare>(rhs), EmptyBase<NodeAllocator>(NodeTraits::select_on_container_copy_construction(rhs.nodeAlloc())),
+         root(nullptr), pFirst(nullptr), pLast(nullptr), numElements(0)
+       { assignTree(root, rhs.root); findEnds(); numElements = rhs.numElements; }                                                     //Copy constructor 
+    BST(BST&& rhs)
+       : KeyCompare<Compare>(rhs), EmptyBase<NodeAllocator>(std::move(rhs.nodeAlloc())),
+         root(rhs.root), pFirst(rhs.pFirst), pLast(rhs.pLast), numElements(rhs.numElements)
+       { rhs.root = rhs.pFirst = rhs.pLast = nullptr; rhs.numElements = 0; }                                              //Move Constructor
+    BST(const std::initializer_list<T>& il, const Compare& comp = Compare(), const Allocator& alloc = Allocator())
+       : KeyCompare<Compare>(comp), EmptyBase<NodeAllocator>(alloc), root(nullptr), pFirst(nullptr), pLast(nullptr), numElements(0) { *this = il; }  //Initializer List Constructor
+    template <typename InputIt, typename = typename std::iterator_traits<InputIt>::iterator_category>
+    BST(InputIt first, InputIt last, const Compare& comp = Compare(), const Allocator& alloc = Allocator())
+       : KeyCompare<Compare>(comp), EmptyBase<NodeAllocator>(alloc), root(nullptr), pFirst(nullptr), pLast(nullptr), numElements(0)
+       { assign(first, last); }                                                                                           //Range Constructor
+    template <typename ForwardIt, typename = typename std::iterator_traits<ForwardIt>::iterator_category>
+    BST(ForwardIt first, ForwardIt last, unsigned numThreads, bool keepUnique = false,
+        const Compare& comp = Compare(), const Allocator& alloc = Allocator())
+       : KeyCompare<Compare>(comp), EmptyBase<NodeAllocator>(alloc), root(nullptr), pFirst(nullptr), pLast(nullptr), numElements(0)
+       { bulkLoad(first, last, numThreads, keepUnique); }                                                                //Parallel Bulk-Load Constructor
     ~BST() { clear(); }
 
    //
@@ -58,31 +572,128 @@ public:
    BST & operator = (const BST &  rhs); 
    BST & operator = (      BST && rhs);
    BST & operator = (const std::initializer_list<T>& il);
+   template <typename InputIt, typename = typename std::iterator_traits<InputIt>::iterator_category>
+   void assign(InputIt first, InputIt last);
    void swap(BST & rhs);
 
    //
    // Iterator
    //
+   // the elements hold the ordering, so no iterator may change them and a
+   // const_iterator is just another name for iterator (as in std::set)
    class iterator;
-   iterator   begin() const noexcept;
-   iterator   end()   const noexcept { return iterator(nullptr); }
+   typedef iterator                              const_iterator;
+   typedef std::reverse_iterator<iterator>       reverse_iterator;
+   typedef std::reverse_iterator<const_iterator> const_reverse_iterator;
+   iterator   begin() const noexcept { return iterator(firstNode(), this); }
+   iterator   end()   const noexcept { return iterator(nullptr,     this); }
+   reverse_iterator rbegin() const noexcept { return reverse_iterator(end());   }
+   reverse_iterator rend()   const noexcept { return reverse_iterator(begin()); }
+   const_iterator   cbegin()  const noexcept { return begin();  }
+   const_iterator   cend()    const noexcept { return end();    }
+   const_reverse_iterator crbegin() const noexcept { return rbegin(); }
+   const_reverse_iterator crend()   const noexcept { return rend();   }
 
    //
    // Access
    //
-   iterator find(const T& t);
+   // with a transparent comparator (one that defines is_transparent) these
+   // also take any key the comparator can order against T
+   iterator find(const T& t) const { return iterator(findNode(t), this); }
+   size_t   count(const T& t) const { return countKey(t); }
+   iterator lower_bound(const T& t) const { return iterator(lowerBound(t), this); }
+   iterator upper_bound(const T& t) const { return iterator(upperBound(t), this); }
+   std::pair<iterator, iterator> equal_range(const T& t) const
+      { return std::make_pair(lower_bound(t), upper_bound(t)); }
+   template <typename K, typename C = Compare, typename = typename C::is_transparent>
+   iterator find(const K& k) const { return iterator(findNode(k), this); }
+   template <typename K, typename C = Compare, typename = typename C::is_transparent>
+   size_t   count(const K& k) const { return countKey(k); }
+   template <typename K, typename C = Compare, typename = typename C::is_transparent>
+   iterator lower_bound(const K& k) const { return iterator(lowerBound(k), this); }
+   template <typename K, typename C = Compare, typename = typename C::is_transparent>
+   iterator upper_bound(const K& k) const { return iterator(upperBound(k), this); }
+   template <typename K, typename C = Compare, typename = typename C::is_transparent>
+   std::pair<iterator, iterator> equal_range(const K& k) const
+      { return std::make_pair(lower_bound(k), upper_bound(k)); }
+   FrozenBST<T, Compare> freeze() const { return FrozenBST<T, Compare>(begin(), end(), key_comp()); }
+   template <typename ForwardIt, typename OutputIt>
+   OutputIt find_batch(ForwardIt first, ForwardIt last, OutputIt out) const;   // find() of each key
+
+   //
+   // Order statistics - only when isCounted
+   //
+   iterator select(size_t k) const { return iterator(selectNode(k), this); } // the k-th smallest, from 0
+   size_t   rank(const T& t) const { return rankKey(t); }                      // how many are less than t
+   template <typename K, typename C = Compare, typename = typename C::is_transparent>
+   size_t   rank(const K& k) const { return rankKey(k); }
+   iterator advance(iterator it, std::ptrdiff_t k) const;
 
    // 
    // Insert
    //
    std::pair<iterator, bool> insert(const T&  t, bool keepUnique = false);
    std::pair<iterator, bool> insert(      T&& t, bool keepUnique = false);
+   iterator insert(iterator hint, const T&  t, bool keepUnique = false);
+   iterator insert(iterator hint,       T&& t, bool keepUnique = false);
+   template <typename InputIt, typename = typename std::iterator_traits<InputIt>::iterator_category>
+   void insert(InputIt first, InputIt last, bool keepUnique = false);
+   template <typename ... Args>
+   std::pair<iterator, bool> emplace       (Args && ... args);
+   template <typename ... Args>
+   std::pair<iterator, bool> emplace_unique(Args && ... args);
+   template <typename ... Args>
+   iterator emplace_hint(iterator hint, Args && ... args);
+   void merge(BST & rhs, bool keepUnique = false);
+   static BST join(BST && lhs, BST && rhs);     // needs isCounted
 
    //
    // Remove
    // 
    iterator erase(iterator& it);
+   iterator erase(iterator first, iterator last);
+   size_t   erase(const T& t) { return eraseKey(t); }
+   template <typename K, typename C = Compare, typename = typename C::is_transparent,
+             typename = typename std::enable_if<!std::is_convertible<K, iterator>::value>::type>
+   size_t   erase(const K& k) { return eraseKey(k); }
+   size_t erase_range(const T & lo, const T & hi);
    void   clear() noexcept;
+   BST    split(const T & key);                  // needs isCounted
+
+   //
+   // Set operations - O(n + m), the result is balanced. With the
+   // same multiset rules as std::set_union and friends. The move-in
+   // versions reuse the nodes of both trees. Given more than one
+   // thread (0 means one per core) the work is split up by key
+   //
+   static BST set_union               (const BST & lhs, const BST & rhs, unsigned numThreads = 1)
+      { return setOperation(lhs, rhs, KEEP_LEFT | KEEP_RIGHT | KEEP_BOTH, numThreads); }
+   static BST set_intersection        (const BST & lhs, const BST & rhs, unsigned numThreads = 1)
+      { return setOperation(lhs, rhs, KEEP_BOTH, numThreads); }
+   static BST set_difference          (const BST & lhs, const BST & rhs, unsigned numThreads = 1)
+      { return setOperation(lhs, rhs, KEEP_LEFT, numThreads); }
+   static BST set_symmetric_difference(const BST & lhs, const BST & rhs, unsigned numThreads = 1)
+      { return setOperation(lhs, rhs, KEEP_LEFT | KEEP_RIGHT, numThreads); }
+   static BST set_union               (BST && lhs, BST && rhs, unsigned numThreads = 1)
+      { return setOperation(std::move(lhs), std::move(rhs), KEEP_LEFT | KEEP_RIGHT | KEEP_BOTH, numThreads); }
+   static BST set_intersection        (BST && lhs, BST && rhs, unsigned numThreads = 1)
+      { return setOperation(std::move(lhs), std::move(rhs), KEEP_BOTH, numThreads); }
+   static BST set_difference          (BST && lhs, BST && rhs, unsigned numThreads = 1)
+      { return setOperation(std::move(lhs), std::move(rhs), KEEP_LEFT, numThreads); }
+   static BST set_symmetric_difference(BST && lhs, BST && rhs, unsigned numThreads = 1)
+      { return setOperation(std::move(lhs), std::move(rhs), KEEP_LEFT | KEEP_RIGHT, numThreads); }
+
+   //
+   // Node handles - move a node between trees without copying it
+   //
+   class node_type;
+   struct insert_return_type;
+   node_type extract(iterator it);
+   node_type extract(const T& t) { return extract(find(t)); }
+   template <typename K, typename C = Compare, typename = typename C::is_transparent,
+             typename = typename std::enable_if<!std::is_convertible<K, iterator>::value>::type>
+   node_type extract(const K& k) { return extract(find(k)); }
+   insert_return_type insert(node_type && nh, bool keepUnique = false);
 
    // 
    // Status
@@ -90,6 +701,12 @@ public:
    bool   empty() const noexcept { return numElements == 0; }
    size_t size()  const noexcept { return numElements;   }
 
+   //
+   // Ordering and memory
+   //
+   using KeyCompare<Compare>::key_comp;
+   allocator_type get_allocator() const { return allocator_type(nodeAlloc()); }
+
    
    
 #ifdef DEBUG // make this visible to the unit tests
@@ -98,74 +715,200 @@ public:
 private:
 #endif
 
-   class BNode;
+   typedef BSTNode <T, isCounted> BNode;
    BNode * root;              // root node of the binary search tree
-   void removeNode(BNode* pNode);
+   BNode * pFirst;            // left-most node, nullptr when empty
+   BNode * pLast;             // right-most node, nullptr when empty
+   BNode * firstNode() const { return pFirst; }
+   BNode * lastNode () const { return pLast;  }
+   void findEnds() { pFirst = BNode::first(root); pLast = BNode::last(root); }  // after root is rebuilt, O(log n)
+
+   // every BNode comes from the caller's allocator, rebound to BNode
+   // and held in an EMPTY BASE so std::allocator takes up no room
+   typedef typename std::allocator_traits<Allocator>::template rebind_alloc<BNode> NodeAllocator;
+   typedef std::allocator_traits<NodeAllocator> NodeTraits;
+   NodeAllocator       & nodeAlloc()       { return EmptyBase<NodeAllocator>::get(); }
+   const NodeAllocator & nodeAlloc() const { return EmptyBase<NodeAllocator>::get(); }
+   template <typename ... Args>
+   BNode * newNode(Args && ... args);
+   void deleteNode(BNode * pNode);
+
+   // allocator propagation, picked at compile time from the allocator's traits
+   void copyAllocator(const BST & rhs, std::true_type ) { nodeAlloc() = rhs.nodeAlloc(); }
+   void copyAllocator(const BST &    , std::false_type) { }
+   void moveAllocator(BST & rhs, std::true_type ) { nodeAlloc() = std::move(rhs.nodeAlloc()); }
+   void moveAllocator(BST &    , std::false_type) { }
+   void swapAllocator(BST & rhs, std::true_type ) { using std::swap; swap(nodeAlloc(), rhs.nodeAlloc()); }
+   void swapAllocator(BST &    , std::false_type) { }
+
+   // allocators with release() and canRelease() (like PoolAllocator)
+   // can free every node at once, when no copy may still need any
+   template <typename A, typename = void>
+   struct CanRelease : std::false_type {};
+   template <typename A>
+   struct CanRelease <A, decltype(std::declval<A &>().release(), std::declval<A &>().canRelease(), void())> : std::true_type {};
+   void releaseNodes(std::true_type);
+   void releaseNodes(std::false_type);
+   void destroyValues(BNode * pThis);
+
    
    void clear(BNode*& pThis);
-   void assign(BNode*& pDest, const BNode* pSrc);
-   size_t numElements;        // number of elements currently in the tree
-};
+   void assignTree(BNode*& pDest, const BNode* pSrc);
+   BNode * takeApart(BNode * & pTree);
+   template <typename Arg>
+   BNode * makeNode(BNode * & pSpares, Arg && value);
+   BNode * copyNode(const BNode * pSrc, BNode * & pSpares);
 
-/*****************************************************************
- * BINARY NODE
- * A single node in a binary tree. Note that the node does not know
- * anything about the properties of the tree so no validation can be done.
- *****************************************************************/
-template <typename T>
-class BST <T> :: BNode
-{
-public:
-   // 
-   // Construct
-   //
-    BNode() : pLeft(nullptr), pRight(nullptr), pParent(nullptr), data(T()) { isRed = true; }				// Default Constructor
-    BNode(const T& t) : pParent(nullptr), pLeft(nullptr), pRight(nullptr), data(t) { isRed = true; }		// Copy Constructor
-    BNode(T&& t) : pParent(nullptr), pLeft(nullptr), pRight(nullptr), data(std::move(t)) { isRed = true; }	// Move Constructor
+   // bulk building from a range, already sorted or sorted on the way in
+   template <typename InputIt>
+   void assignRange(InputIt first, InputIt last, std::input_iterator_tag);
+   template <typename ForwardIt>
+   void assignRange(ForwardIt first, ForwardIt last, std::forward_iterator_tag);
+   template <typename Next>
+   BNode * buildBalanced(Next & next, size_t num, size_t depth, size_t depthRed);
+   template <typename ForwardIt>
+   void bulkLoad(ForwardIt first, ForwardIt last, unsigned numThreads, bool keepUnique);
+   static size_t redDepth(size_t num);
+   BNode * findParent(const T & t, bool keepUnique, BNode * & pParent, bool & isLeft) const;
+   template <typename K>
+   BNode * findNode(const K & k) const;
+   enum { FIND_BATCH = 16 };  // how many find_batch() descents run side by side
+   template <typename K>
+   BNode * lowerBound(const K & k) const;
+   template <typename K>
+   BNode * upperBound(const K & k) const;
+   template <typename K>
+   size_t countKey(const K & k) const;
+   template <typename K>
+   size_t eraseKey(const K & k);
+   BNode * selectNode(size_t k) const;
+   size_t  rankNode(const BNode * pNode) const;
+   template <typename K>
+   size_t  rankKey(const K & k) const;
 
-   //
-   // Insert
-   //
-   void addLeft (BNode * pNode);
-   void addRight(BNode * pNode);
-   void addLeft (const T &  t);
-   void addRight(const T &  t);
-   void addLeft (      T && t);
-   void addRight(      T && t);
+   // emplace searches with the argument first when it already is a T,
+   // otherwise it has to build the T before it knows where it goes
+   template <typename ... Args>
+   struct IsValue : std::false_type {};
+   template <typename Arg>
+   struct IsValue <Arg> : std::is_same<typename std::decay<Arg>::type, T> {};
+   template <typename Arg>
+   std::pair<iterator, bool> emplaceNode(std::true_type,  bool keepUnique, Arg && t);
+   template <typename ... Args>
+   std::pair<iterator, bool> emplaceNode(std::false_type, bool keepUnique, Args && ... args);
+   BNode * findParent(BNode * pHint, const T & t, bool keepUnique, BNode * & pParent, bool & isLeft) const;
+   template <typename Arg>
+   iterator emplaceHint(std::true_type,  BNode * pHint, bool keepUnique, Arg && t);
+   template <typename ... Args>
+   iterator emplaceHint(std::false_type, BNode * pHint, bool keepUnique, Args && ... args);
+   void link(BNode * pNew, BNode * pParent, bool isLeft);
+   BNode * unlink(BNode * pNode);
+   BNode * insertBatch(BNode * pNode, size_t height, BNode * const * pBatch, size_t num, bool keepUnique,
+                       std::vector<BNode *> & rejected, size_t & heightResult);
 
-   void clear(BNode* pThis);
-   
+   // set operations: which elements make it into the result
+   enum { KEEP_LEFT = 1,      // only in lhs
+          KEEP_RIGHT = 2,     // only in rhs
+          KEEP_BOTH = 4 };    // in both (lhs's copy is kept)
+   static BST setOperation(const BST & lhs, const BST & rhs, int keep, unsigned numThreads);
+   static BST setOperation(BST && lhs, BST && rhs, int keep, unsigned numThreads);
+   BNode * copySet(BNode * const * pLeft, size_t numLeft, BNode * const * pRight, size_t numRight, int keep,
+                   unsigned numThreads, std::mutex & lockAlloc, size_t & height, size_t & num);
+   BNode * copyRun(BNode * const * pLeft, size_t numLeft, BNode * const * pRight, size_t numRight, int keep,
+                   std::mutex & lockAlloc, size_t & num);
+   BNode * moveSet(BNode * pLeft, size_t heightLeft, BNode * pRight, size_t heightRight, int keep,
+                   unsigned numThreads, std::mutex & lockAlloc, size_t & height, size_t & num);
+   BNode * moveRun(BNode * pLeft, BNode * pRight, int keep, std::mutex & lockAlloc, size_t & num);
+   template <typename It, typename Sort>
+   void mergeSequences(It itLeft, It endLeft, It itRight, It endRight, int keep, Sort sort) const;
+   void flatten(std::vector<BNode *> & nodes, unsigned numThreads) const;
+   static void findTops(BNode * pNode, size_t depth, std::vector<std::pair<BNode *, bool> > & tops);
+   static size_t countNodes(const BNode * pNode);
 
-   // 
-   // Status
-   //
-   bool isRightChild(BNode* pNode) const { return pNode->pParent->data < pNode->data; } // DON'T KNOW IF IT CHANGES ANYTHING
-   bool isLeftChild (BNode* pNode) const { return pNode->data < pNode->pParent->data; } // <-/
+   // a run: nodes in order, each linked to the next through pRight
+   struct RunIterator
+   {
+      BNode * p;
+      BNode * operator * () const { return p; }
+      RunIterator & operator ++ () { p = p->pRight; return *this; }
+      RunIterator operator ++ (int) { RunIterator it = *this; p = p->pRight; return it; }
+      bool operator != (const RunIterator & rhs) const { return p != rhs.p; }
+   };
+   static BNode * toRun(BNode * pNode, BNode * pTail);
+   BNode * joinRun(BNode * pLeft, size_t heightLeft, BNode * pRun, size_t numRun, BNode * pRight, size_t heightRight,
+                   size_t & height);
+   void deleteRun(BNode * pRun, std::mutex & lockAlloc);
 
-   //
-   // Data
-   //
-   T data;                  // Actual data stored in the BNode
-   BNode* pLeft;            // Left child - smaller
-   BNode* pRight;           // Right child - larger
-   BNode* pParent;          // Parent
-   bool isRed;              // Red-black balancing stuff
+   // spreading work over threads. An allocator that is always equal
+   // (std::allocator, say) is taken to be thread safe; any other is
+   // only used under a lock when several threads allocate at once
+   enum { MIN_PARALLEL = 8192 };  // fewer elements than this are not worth a thread
+   template <typename A, typename = void>
+   struct IsThreadSafe : std::is_empty<A> {};
+   template <typename A>
+   struct IsThreadSafe <A, typename std::conditional<true, void, typename A::is_always_equal>::type> : A::is_always_equal {};
+   class AllocLock : public std::unique_lock<std::mutex>
+   {
+   public:
+      AllocLock(std::mutex & lockAlloc) : std::unique_lock<std::mutex>(lockAlloc, std::defer_lock)
+      {
+         if (!IsThreadSafe<NodeAllocator>::value)
+            lock();
+      }
+   };
+   void deleteNode(BNode * pNode, std::mutex & lockAlloc);
+   static unsigned threadCount(unsigned numThreads, size_t num);
+   template <typename Function>
+   static void parallelFor(size_t num, unsigned numThreads, Function function);
+   template <typename RandomIt, typename Less>
+   static void parallelSort(RandomIt first, RandomIt last, Less less, unsigned numThreads);
+   template <typename From, typename To, typename Less>
+   static void mergeRound(From from, To to, const std::vector<size_t> & bounds, size_t width, Less less, unsigned numThreads);
+   template <typename RandomIt, typename Less>
+   static size_t coRank(RandomIt itLeft, size_t numLeft, RandomIt itRight, size_t numRight, size_t k, Less less);
+   template <typename Source>
+   void copyNodes(std::vector<BNode *> & nodes, size_t num, Source source, unsigned numThreads, std::mutex & lockAlloc);
+   static BNode * linkBalanced(BNode * const * pNodes, size_t num, size_t depth, size_t depthRed, unsigned numThreads);
+
+   // red-black balancing
+   static size_t blackHeight(const BNode * pNode);
+   static BNode * join(BNode * pLeft, size_t heightLeft, BNode * pMid, BNode * pRight, size_t heightRight,
+                       size_t & heightResult);
+   template <typename Before>
+   void splitNode(BNode * pNode, size_t height, Before isBefore,
+                  BNode * & pLeft, size_t & heightLeft, BNode * & pRight, size_t & heightRight);
+   void splitAt(BNode * pNode, size_t height, BNode * pTarget,
+                BNode * & pLeft, size_t & heightLeft, BNode * & pRight, size_t & heightRight);
+   static void replace    (BNode * & pRoot, BNode * pOld, BNode * pNew);
+   static void rotateLeft (BNode * & pRoot, BNode * pNode);
+   static void rotateRight(BNode * & pRoot, BNode * pNode);
+   static bool insertFixup(BNode * & pRoot, BNode * pNode);
+   void eraseFixup (BNode * pNode, BNode * pParent);
+   size_t numElements;        // number of elements currently in the tree
 };
 
 /**********************************************************
  * BINARY SEARCH TREE ITERATOR
  * Forward and reverse iterator through a BST
  *********************************************************/
-template <typename T>
-class BST <T> :: iterator
+template <typename T, typename Compare, typename Allocator, bool isCounted>
+class BST <T, Compare, Allocator, isCounted> :: iterator
 {
 public:
-   // constructors and assignment
-   iterator(BNode* p = nullptr): pNode(p) { }
-   iterator(const iterator& rhs) { pNode = rhs.pNode; }
+   // so std::reverse_iterator and the standard algorithms can use it
+   typedef std::bidirectional_iterator_tag iterator_category;
+   typedef T           value_type;
+   typedef std::ptrdiff_t difference_type;
+   typedef const T *   pointer;
+   typedef const T &   reference;
+
+   // constructors and assignment. Knowing the tree lets end() step back
+   iterator(BNode* p = nullptr, const BST* pBST = nullptr): pNode(p), pTree(pBST) { }
+   iterator(const iterator& rhs) { pNode = rhs.pNode; pTree = rhs.pTree; }
    iterator & operator = (const iterator & rhs)
    {
         pNode = rhs.pNode;
+        pTree = rhs.pTree;
         return *this;
    }
 
@@ -196,8 +939,8 @@ public:
        return it;
    }
 
-   // must give friend status to remove so it can call getNode() from it
-   friend BST <T> :: iterator BST <T> :: erase(iterator & it);
+   // must give friend status to the tree so it can get at the node
+   friend class BST <T, Compare, Allocator, isCounted>;
 
 #ifdef DEBUG // make this visible to the unit tests
 public:
@@ -205,33 +948,145 @@ public:
 private:
 #endif
    
-    // the node
+    // the node, and the tree it is in
     BNode * pNode;
+    const BST * pTree;
 };
 
-/*********************************************
- *********************************************
- *******************       *******************
- *******************  BST  *******************
- *******************       *******************
- *********************************************
- *********************************************/
-
-/*********************************************
- * BST :: ASSIGNMENT OPERATOR
- * Copy one tree to another
- ********************************************/
-template <typename T>
-BST <T> & BST <T> :: operator = (const BST <T> & rhs)
+/**********************************************************
+ * BST NODE HANDLE
+ * Owns one node taken out of a tree by extract(), ready to
+ * be inserted into another tree. One whose allocator does
+ * not compare equal moves the value into a node of its own.
+ * Like the std:: node handles, it keeps its own copy of the
+ * allocator the node came from, so it may outlive that tree
+ *********************************************************/
+template <typename T, typename Compare, typename Allocator, bool isCounted>
+class BST <T, Compare, Allocator, isCounted> :: node_type
 {
-    /*
-        TestBST::test_constructCopy_one()
-                line:185 condition:bstDest.root != nullptr
+public:
+   typedef T         value_type;
+   typedef Allocator allocator_type;
+
+   // move only, like the node it owns
+   node_type() : pNode(nullptr) { }
+   node_type(node_type && rhs) : pNode(nullptr) { take(rhs); }
+   node_type & operator = (node_type && rhs)
+   {
+      if (this != &rhs)
+      {
+         reset();
+         take(rhs);
+      }
+      return *this;
+   }
+   node_type(const node_type &) = delete;
+   node_type & operator = (const node_type &) = delete;
+   ~node_type() { reset(); }
+
+   // status and access. The value may be changed while it is out of a tree
+   bool empty() const noexcept { return pNode == nullptr; }
+   explicit operator bool() const noexcept { return pNode != nullptr; }
+   value_type & value() const { return pNode->data; }
+   allocator_type get_allocator() const { return allocator_type(alloc); }
+   void swap(node_type & rhs)
+   {
+      node_type temp(std::move(rhs));
+      rhs = std::move(*this);
+      *this = std::move(temp);
+   }
+
+   // the tree makes handles and takes their nodes back
+   friend class BST <T, Compare, Allocator, isCounted>;
+
+#ifdef DEBUG // make this visible to the unit tests
+public:
+#else
+private:
+#endif
+
+   node_type(BNode * p, const NodeAllocator & a) : pNode(p) { new (&alloc) NodeAllocator(a); }
+
+   // give up the node, which must be there, and the allocator with it
+   BNode * release()
+   {
+      BNode* p = pNode;
+      pNode = nullptr;
+      alloc.~NodeAllocator();
+      return p;
+   }
+   void take(node_type & rhs)
+   {
+      if (rhs.pNode)
+      {
+         new (&alloc) NodeAllocator(std::move(rhs.alloc));
+         pNode = rhs.release();
+      }
+   }
+   void reset()
+   {
+      if (pNode)
+      {
+         NodeTraits::destroy(alloc, pNode);
+         NodeTraits::deallocate(alloc, pNode, 1);
+         release();
+      }
+   }
+
+   BNode * pNode;              // the node we own, if any
+   union
+   {
+      NodeAllocator alloc;     // where it has to go back to, only while we own it
+   };
+};
+
+/**********************************************************
+ * BST INSERT RETURN TYPE
+ * What inserting a node handle did: where the value is,
+ * whether the node went in, and the node if it did not
+ *********************************************************/
+template <typename T, typename Compare, typename Allocator, bool isCounted>
+struct BST <T, Compare, Allocator, isCounted> :: insert_return_type
+{
+   iterator  position;
+   bool      inserted;
+   node_type node;
+};
+
+/*********************************************
+ *********************************************
+ *******************       *******************
+ *******************  BST  *******************
+ *******************       *******************
+ *********************************************
+ *********************************************/
+
+/*********************************************
+ * BST :: ASSIGNMENT OPERATOR
+ * Copy one tree to another
+ ********************************************/
+template <typename T, typename Compare, typename Allocator, bool isCounted>
+BST <T, Compare, Allocator, isCounted> & BST <T, Compare, Allocator, isCounted> :: operator = (const BST <T, Compare, Allocator, isCounted> & rhs)
+{
+    /*
+        TestBST::test_constructCopy_one()
+                line:185 condition:bstDest.root != nullptr
         TestBST::test_constructCopy_standard()
                 line:240 condition:bst.root != nullptr
                 line:240 condition:bst.root != nullptr
     */
-    assign(root, rhs.root);
+    if (this == &rhs)
+        return *this;
+
+    // nodes from our allocator cannot be reused if we are taking theirs
+    typename NodeTraits::propagate_on_container_copy_assignment propagate;
+    if (propagate && !(nodeAlloc() == rhs.nodeAlloc()))
+        clear();
+    copyAllocator(rhs, propagate);
+    static_cast<KeyCompare<Compare> &>(*this) = rhs;
+
+    assignTree(root, rhs.root);
+    findEnds();
     numElements = rhs.numElements;
     return *this;
 }
@@ -240,26 +1095,253 @@ BST <T> & BST <T> :: operator = (const BST <T> & rhs)
  * BST :: ASSIGNMENT OPERATOR with INITIALIZATION LIST
  * Copy nodes onto a BTree
  ********************************************/
-template <typename T>
-BST <T> & BST <T> :: operator = (const std::initializer_list<T>& il)
+template <typename T, typename Compare, typename Allocator, bool isCounted>
+BST <T, Compare, Allocator, isCounted> & BST <T, Compare, Allocator, isCounted> :: operator = (const std::initializer_list<T>& il)
+{
+    assign(il.begin(), il.end());
+    return *this;
+}
+
+/*********************************************
+ * BST :: ASSIGN a range
+ * Replace the contents with [first, last). A range
+ * we can walk more than once is built directly into
+ * a balanced tree in linear time, one copy per element;
+ * a single-pass range is inserted one at a time
+ ********************************************/
+template <typename T, typename Compare, typename Allocator, bool isCounted>
+template <typename InputIt, typename>
+void BST <T, Compare, Allocator, isCounted> :: assign(InputIt first, InputIt last)
+{
+    assignRange(first, last, typename std::iterator_traits<InputIt>::iterator_category());
+}
+
+/*********************************************
+ * BST :: ASSIGN RANGE - single pass
+ * We cannot count or look back, so insert at the end.
+ * Sorted input hits the hint every time
+ ********************************************/
+template <typename T, typename Compare, typename Allocator, bool isCounted>
+template <typename InputIt>
+void BST <T, Compare, Allocator, isCounted> :: assignRange(InputIt first, InputIt last, std::input_iterator_tag)
 {
     clear();
-    for (T t : il) {
-        insert(t);
+    for (; first != last; ++first)
+        emplace_hint(end(), *first);
+}
+
+/*********************************************
+ * BST :: ASSIGN RANGE - multi pass
+ * Sorted input (n - 1 comparisons to find out) is
+ * built straight from the range. Otherwise we sort
+ * iterators to the elements, never the elements
+ * themselves, so either way each element is copied
+ * exactly once. The old nodes are recycled
+ ********************************************/
+template <typename T, typename Compare, typename Allocator, bool isCounted>
+template <typename ForwardIt>
+void BST <T, Compare, Allocator, isCounted> :: assignRange(ForwardIt first, ForwardIt last, std::forward_iterator_tag)
+{
+    size_t num = std::distance(first, last);
+    BNode* pSpares = takeApart(root);
+    pFirst = pLast = nullptr;
+    numElements = 0;
+
+    try
+    {
+        if (std::is_sorted(first, last, key_comp()))
+        {
+            auto next = [this, &first, &pSpares]() { return makeNode(pSpares, *first++); };
+            root = buildBalanced(next, num, 0, redDepth(num));
+        }
+        else
+        {
+            std::vector<ForwardIt> order;
+            order.reserve(num);
+            for (ForwardIt it = first; it != last; ++it)
+                order.push_back(it);
+            std::stable_sort(order.begin(), order.end(),
+                             [this](const ForwardIt& lhs, const ForwardIt& rhs) { return this->isLess(*lhs, *rhs); });
+
+            auto itOrder = order.begin();
+            auto next = [this, &itOrder, &pSpares]() { return makeNode(pSpares, **itOrder++); };
+            root = buildBalanced(next, num, 0, redDepth(num));
+        }
     }
-    return *this;
+    catch (...)
+    {
+        clear(pSpares);
+        throw;
+    }
+
+    clear(pSpares);
+    findEnds();
+    numElements = num;
+}
+
+/*********************************************
+ * BST :: BUILD BALANCED
+ * Build a tree out of the next num detached nodes that
+ * next() hands us in order: the left half, then the
+ * middle, then the right half. Sibling subtrees differ
+ * by at most one node, so every empty child sits on one
+ * of the last two levels and colouring only the deepest
+ * level (depthRed) red gives every path the same black
+ * height
+ ********************************************/
+template <typename T, typename Compare, typename Allocator, bool isCounted>
+template <typename Next>
+typename BST <T, Compare, Allocator, isCounted> :: BNode * BST <T, Compare, Allocator, isCounted> ::buildBalanced(Next& next, size_t num, size_t depth, size_t depthRed)
+{
+    if (num == 0)
+        return nullptr;
+
+    size_t numLeft = (num - 1) / 2;
+    BNode* pLeft = buildBalanced(next, numLeft, depth + 1, depthRed);
+    BNode* pNode;
+    try
+    {
+        pNode = next();
+    }
+    catch (...)
+    {
+        clear(pLeft);
+        throw;
+    }
+    pNode->isRed = depth != 0 && depth == depthRed;
+    pNode->setCount(num);
+    pNode->addLeft(pLeft);
+
+    try
+    {
+        pNode->addRight(buildBalanced(next, num - 1 - numLeft, depth + 1, depthRed));
+    }
+    catch (...)
+    {
+        clear(pNode);
+        throw;
+    }
+    return pNode;
+}
+
+/*********************************************
+ * BST :: BULK LOAD
+ * Build an empty tree from an unsorted range using
+ * numThreads threads (0 means one per core): sort
+ * iterators to the elements in parallel, drop all but
+ * the first of each run of equal elements if asked,
+ * then copy and link the nodes in parallel. Each
+ * element is copied once; it is never moved around.
+ * Checking the order and dropping duplicates are done
+ * a block per thread: an element only needs the one
+ * before it, even when that is in the block before
+ ********************************************/
+template <typename T, typename Compare, typename Allocator, bool isCounted>
+template <typename ForwardIt>
+void BST <T, Compare, Allocator, isCounted> :: bulkLoad(ForwardIt first, ForwardIt last, unsigned numThreads, bool keepUnique)
+{
+    static_assert(std::is_base_of<std::forward_iterator_tag,
+                                  typename std::iterator_traits<ForwardIt>::iterator_category>::value,
+                  "bulk loading walks the range more than once");
+    assert(empty());
+
+    std::vector<ForwardIt> order;
+    for (ForwardIt it = first; it != last; ++it)
+        order.push_back(it);
+    numThreads = threadCount(numThreads, order.size());
+    std::vector<size_t> bounds(numThreads + 1);
+    for (size_t i = 0; i <= numThreads; i++)
+        bounds[i] = order.size() * i / numThreads;
+
+    // sorted already?
+    auto isBefore = [this](const ForwardIt & lhs, const ForwardIt & rhs) { return this->isLess(*lhs, *rhs); };
+    std::vector<char> isSorted(numThreads, true);
+    parallelFor(numThreads, numThreads, [&](size_t begin, size_t end)
+    {
+        for (size_t b = begin; b < end; b++)
+            for (size_t i = std::max<size_t>(bounds[b], 1); i < bounds[b + 1] && isSorted[b]; i++)
+                isSorted[b] = !isBefore(order[i], order[i - 1]);
+    });
+    if (std::find(isSorted.begin(), isSorted.end(), false) != isSorted.end())
+        parallelSort(order.begin(), order.end(), isBefore, numThreads);
+
+    // keep an element only if it sorts after the one before it. Each
+    // block counts its keepers, to see where they go, then copies them
+    if (keepUnique)
+    {
+        auto isKept = [&order, &isBefore](size_t i) { return i == 0 || isBefore(order[i - 1], order[i]); };
+        std::vector<size_t> starts(numThreads + 1, 0);
+        parallelFor(numThreads, numThreads, [&](size_t begin, size_t end)
+        {
+            for (size_t b = begin; b < end; b++)
+                for (size_t i = bounds[b]; i < bounds[b + 1]; i++)
+                    if (isKept(i))
+                        starts[b + 1]++;
+        });
+        for (size_t b = 0; b < numThreads; b++)
+            starts[b + 1] += starts[b];
+
+        std::vector<ForwardIt> kept(starts.back());
+        parallelFor(numThreads, numThreads, [&](size_t begin, size_t end)
+        {
+            for (size_t b = begin; b < end; b++)
+                for (size_t i = bounds[b], j = starts[b]; i < bounds[b + 1]; i++)
+                    if (isKept(i))
+                        kept[j++] = order[i];
+        });
+        order.swap(kept);
+    }
+
+    size_t num = order.size();
+    std::vector<BNode *> nodes;
+    std::mutex lockAlloc;
+    copyNodes(nodes, num, [&order](size_t i) -> const T & { return *order[i]; }, numThreads, lockAlloc);
+    root = linkBalanced(nodes.data(), num, 0, redDepth(num), numThreads);
+    findEnds();
+    numElements = num;
+}
+
+/*********************************************
+ * BST :: RED DEPTH
+ * The deepest level of a balanced tree of num nodes,
+ * the one BUILD BALANCED colours red
+ ********************************************/
+template <typename T, typename Compare, typename Allocator, bool isCounted>
+size_t BST <T, Compare, Allocator, isCounted> ::redDepth(size_t num)
+{
+    size_t depth = 0;
+    for (; num > 1; num /= 2)
+        depth++;
+    return depth;
 }
 
 /*********************************************
  * BST :: ASSIGN-MOVE OPERATOR
  * Move one tree to another
  ********************************************/
-template <typename T>
-BST <T> & BST <T> :: operator = (BST <T> && rhs)
+template <typename T, typename Compare, typename Allocator, bool isCounted>
+BST <T, Compare, Allocator, isCounted> & BST <T, Compare, Allocator, isCounted> :: operator = (BST <T, Compare, Allocator, isCounted> && rhs)
 {
-    // This still isn't right, but I think it's because we don't have clear
     clear();
-    swap(rhs);
+
+    // if we cannot take their allocator and it is not the same as ours,
+    // their nodes cannot change hands so copy them instead
+    typename NodeTraits::propagate_on_container_move_assignment propagate;
+    if (!propagate && !(nodeAlloc() == rhs.nodeAlloc()))
+    {
+        *this = rhs;
+        rhs.clear();
+        return *this;
+    }
+
+    moveAllocator(rhs, propagate);
+    this->swapCompare(rhs);
+    root = rhs.root;
+    pFirst = rhs.pFirst;
+    pLast = rhs.pLast;
+    numElements = rhs.numElements;
+    rhs.root = rhs.pFirst = rhs.pLast = nullptr;
+    rhs.numElements = 0;
     return *this;
 }
 
@@ -267,290 +1349,2335 @@ BST <T> & BST <T> :: operator = (BST <T> && rhs)
  * BST :: SWAP
  * Swap two trees
  ********************************************/
-template <typename T>
-void BST <T> :: swap (BST <T>& rhs)
+template <typename T, typename Compare, typename Allocator, bool isCounted>
+void BST <T, Compare, Allocator, isCounted> :: swap (BST <T, Compare, Allocator, isCounted> & rhs)
 {
     auto tempRoot = rhs.root;
     rhs.root = root;
     root = tempRoot;
 
+    std::swap(pFirst, rhs.pFirst);
+    std::swap(pLast,  rhs.pLast);
+
     auto tempElements = rhs.numElements;
     rhs.numElements = numElements;
     numElements = tempElements;
+
+    this->swapCompare(rhs);
+    swapAllocator(rhs, typename NodeTraits::propagate_on_container_swap());
 }
 
-template <typename T>
-void BST <T> ::assign(BNode*& pDest, const BNode* pSrc)
+/*********************************************
+ * BST :: ASSIGN TREE
+ * Make pDest a copy of pSrc without recursion. Every node
+ * already in pDest is recycled (its data assigned over)
+ * before anything new is allocated, whatever the shapes
+ * of the two trees, so copying onto a tree of the same
+ * size never touches the heap
+ ********************************************/
+template <typename T, typename Compare, typename Allocator, bool isCounted>
+void BST <T, Compare, Allocator, isCounted> ::assignTree(BNode*& pDest, const BNode* pSrc)
 {
-    // Source is Empty
-    if (!pSrc) {
-        clear(pDest);
-        return;
-    }
+    BNode* pSpares = takeApart(pDest);
 
-    // Neither the Source nor Destination are Empty
-    if (pDest && pSrc) {
-        pDest->data = pSrc->data;
-        assign(pDest->pRight, pSrc->pRight);
-        assign(pDest->pLeft, pSrc->pLeft);
+    try
+    {
+        // walk the source in preorder using the parent pointers, building
+        // the matching destination node just before we step into a child
+        if (pSrc)
+        {
+            pDest = copyNode(pSrc, pSpares);
+            const BNode* pS = pSrc;
+            BNode* pD = pDest;
+            for (;;)
+            {
+                if (pS->pLeft && !pD->pLeft)
+                {
+                    pD->addLeft(copyNode(pS->pLeft, pSpares));
+                    pS = pS->pLeft;
+                    pD = pD->pLeft;
+                }
+                else if (pS->pRight && !pD->pRight)
+                {
+                    pD->addRight(copyNode(pS->pRight, pSpares));
+                    pS = pS->pRight;
+                    pD = pD->pRight;
+                }
+                else if (pS == pSrc)
+                    break;
+                else
+                {
+                    pS = pS->pParent;
+                    pD = pD->pParent;
+                }
+            }
+        }
     }
-
-    // Destination is Empty
-    if (!pDest && pSrc) {
-        pDest = new BST::BNode(pSrc->data);
-        assign(pDest->pRight, pSrc->pRight);
-        assign(pDest->pLeft, pSrc->pLeft);
+    catch (...)
+    {
+        clear(pDest);
+        clear(pSpares);
+        numElements = 0;
+        throw;
     }
 
-    // Setting parent values
-    if (pDest->pRight)
-        pDest->pRight->pParent = pDest;
-    if (pDest->pLeft)
-        pDest->pLeft->pParent = pDest;
+    // whatever is left over was not needed
+    clear(pSpares);
 }
 
-/*****************************************************
- * BST :: INSERT
- * Insert a node at a given location in the tree
- ****************************************************/
-template <typename T>
-std::pair<typename BST <T> :: iterator, bool> BST <T> :: insert(const T & t, bool keepUnique)
+/*********************************************
+ * BST :: TAKE APART
+ * Empty pTree into a list of spare nodes chained
+ * through pRight, in order, rotating left children up
+ * the same way clear() does. Their values are still alive
+ ********************************************/
+template <typename T, typename Compare, typename Allocator, bool isCounted>
+typename BST <T, Compare, Allocator, isCounted> :: BNode * BST <T, Compare, Allocator, isCounted> ::takeApart(BNode*& pTree)
 {
-    iterator it;
-
-    if (keepUnique)
-        it = find(t);
-    if (it == nullptr)
+    BNode* pSpares = nullptr;
+    BNode** ppTail = &pSpares;
+    for (BNode* p = pTree; p; )
     {
-        if (t < root->data)
+        if (p->pLeft)
         {
-            root->addLeft(std::move(t));
-            root->pLeft->pParent = std::move(root);
-            it = iterator(root->pLeft);
+            BNode* pLeft = p->pLeft;
+            p->pLeft = pLeft->pRight;
+            pLeft->pRight = p;
+            p = pLeft;
         }
         else
         {
-            root->addRight(std::move(t));
-            root->pRight->pParent = std::move(root);
-            it = iterator(root->pRight);
+            // nothing is left of p, so it comes next
+            *ppTail = p;
+            ppTail = &p->pRight;
+            p = p->pRight;
         }
+    }
+    *ppTail = nullptr;
+    pTree = nullptr;
+    return pSpares;
+}
 
-        numElements++;
+/*********************************************
+ * BST :: MAKE NODE
+ * A detached node holding value, reusing a spare
+ * node if there is one
+ ********************************************/
+template <typename T, typename Compare, typename Allocator, bool isCounted>
+template <typename Arg>
+typename BST <T, Compare, Allocator, isCounted> :: BNode * BST <T, Compare, Allocator, isCounted> ::makeNode(BNode*& pSpares, Arg&& value)
+{
+    BNode* pNode;
+    if (pSpares)
+    {
+        pSpares->data = std::forward<Arg>(value);
+        pNode = pSpares;
+        pSpares = pSpares->pRight;
     }
+    else
+        pNode = newNode(std::forward<Arg>(value));
 
-    std::pair<iterator, bool> pairReturn(it, false);
-    return pairReturn;
+    pNode->pLeft = pNode->pRight = pNode->pParent = nullptr;
+    return pNode;
 }
 
-template <typename T>
-std::pair<typename BST <T> ::iterator, bool> BST <T> ::insert(T && t, bool keepUnique)
+/*********************************************
+ * BST :: COPY NODE
+ * A detached copy of pSrc, same colour
+ ********************************************/
+template <typename T, typename Compare, typename Allocator, bool isCounted>
+typename BST <T, Compare, Allocator, isCounted> :: BNode * BST <T, Compare, Allocator, isCounted> ::copyNode(const BNode* pSrc, BNode*& pSpares)
 {
-    iterator it;
-
-    if (keepUnique)
-        it = find(t);
-    if (it == nullptr)
-    {
-        if (t < root->data)
-        {
-            root->addLeft(std::move(t));
-            root->pLeft->pParent = std::move(root);
-            it = iterator(root->pLeft);
-        }
-        else
-        {
-            root->addRight(std::move(t));
-            root->pRight->pParent = std::move(root);
-            it = iterator(root->pRight);
-        }
+    BNode* pNode = makeNode(pSpares, pSrc->data);
+    pNode->isRed = pSrc->isRed;
+    pNode->setCount(pSrc->getCount());
+    return pNode;
+}
 
-        numElements++;
-    }
+/*****************************************************
+ * BST :: INSERT
+ * Insert a node at a given location in the tree
+ ****************************************************/
+template <typename T, typename Compare, typename Allocator, bool isCounted>
+std::pair<typename BST <T, Compare, Allocator, isCounted> :: iterator, bool> BST <T, Compare, Allocator, isCounted> :: insert(const T & t, bool keepUnique)
+{
+    return emplaceNode(std::true_type(), keepUnique, t);
+}
 
-    std::pair<iterator, bool> pairReturn(it, false);
-    return pairReturn;
+template <typename T, typename Compare, typename Allocator, bool isCounted>
+std::pair<typename BST <T, Compare, Allocator, isCounted> ::iterator, bool> BST <T, Compare, Allocator, isCounted> ::insert(T && t, bool keepUnique)
+{
+    return emplaceNode(std::true_type(), keepUnique, std::move(t));
 }
 
-/*************************************************
- * BST :: ERASE
- * Remove a given node as specified by the iterator
- ************************************************/
-template <typename T>
-typename BST <T> ::iterator BST <T> :: erase(iterator & it)
-{  
-    iterator returnIt = it;
-    
-    if (it == end())
-        return end();
+/*****************************************************
+ * BST :: EMPLACE
+ * Build a T from args directly inside a new node and
+ * insert it. Duplicates are allowed
+ ****************************************************/
+template <typename T, typename Compare, typename Allocator, bool isCounted>
+template <typename ... Args>
+std::pair<typename BST <T, Compare, Allocator, isCounted> :: iterator, bool> BST <T, Compare, Allocator, isCounted> :: emplace(Args && ... args)
+{
+    return emplaceNode(IsValue<Args...>(), false, std::forward<Args>(args)...);
+}
 
-    if (returnIt.pNode != nullptr) {
+/*****************************************************
+ * BST :: EMPLACE UNIQUE
+ * Same as EMPLACE, but if an equal element is already
+ * there, return it instead. No node is allocated for a
+ * rejected duplicate
+ ****************************************************/
+template <typename T, typename Compare, typename Allocator, bool isCounted>
+template <typename ... Args>
+std::pair<typename BST <T, Compare, Allocator, isCounted> :: iterator, bool> BST <T, Compare, Allocator, isCounted> :: emplace_unique(Args && ... args)
+{
+    return emplaceNode(IsValue<Args...>(), true, std::forward<Args>(args)...);
+}
 
-        // No Children | COMPLETE
-        if (it.pNode->pLeft == nullptr && it.pNode->pRight == nullptr) {
-            if (it.pNode->pParent) {
-                if (it.pNode->pParent->pRight == it.pNode) {
-                    returnIt.pNode->pParent->pRight = nullptr;
-                }
-                if (it.pNode->pParent->pLeft == it.pNode) {
-                    returnIt.pNode->pParent->pLeft = nullptr;
-                }
-                returnIt = it.pNode->pParent;
-            }
-            delete it.pNode;
-        }
-        //one child | Complete        
-        else if (returnIt.pNode->pRight == nullptr && returnIt.pNode->pLeft) {
-            returnIt.pNode->pLeft->pParent = returnIt.pNode->pParent;
-            if (returnIt.pNode->pParent != nullptr) {
-                if (returnIt.pNode->pParent->pRight == returnIt.pNode) {
-                    returnIt.pNode->pParent->pRight = returnIt.pNode->pLeft;
-                }
-                if (returnIt.pNode->pParent->pLeft == returnIt.pNode) {
-                    returnIt.pNode->pParent->pLeft = returnIt.pNode->pLeft;
-                }
-                returnIt = iterator(returnIt.pNode->pRight);
-                returnIt++;
-            }
-         }
+/*****************************************************
+ * BST :: EMPLACE HINT
+ * EMPLACE, given a guess of where the new element goes
+ * (see FIND PARENT with a hint). The hint is only advice;
+ * the element always lands in the right place
+ ****************************************************/
+template <typename T, typename Compare, typename Allocator, bool isCounted>
+template <typename ... Args>
+typename BST <T, Compare, Allocator, isCounted> :: iterator BST <T, Compare, Allocator, isCounted> :: emplace_hint(iterator hint, Args && ... args)
+{
+    return emplaceHint(IsValue<Args...>(), hint.pNode, false, std::forward<Args>(args)...);
+}
 
-        else if (returnIt.pNode->pLeft == nullptr && returnIt.pNode->pRight) {
-            returnIt.pNode->pRight->pParent = returnIt.pNode->pParent;
-            if (returnIt.pNode->pParent) {
-                if (returnIt.pNode->pParent->pRight == returnIt.pNode) {
-                    returnIt.pNode->pParent->pRight = returnIt.pNode->pRight;
-                }
-                if (returnIt.pNode->pParent->pLeft == returnIt.pNode) {
-                    returnIt.pNode->pParent->pLeft = returnIt.pNode->pRight;
-                }
-            }
-         returnIt++;
-            
-        }
+/*****************************************************
+ * BST :: INSERT with a HINT
+ * Insert t next to hint if it belongs there, which for
+ * sorted input costs a constant number of comparisons
+ ****************************************************/
+template <typename T, typename Compare, typename Allocator, bool isCounted>
+typename BST <T, Compare, Allocator, isCounted> :: iterator BST <T, Compare, Allocator, isCounted> :: insert(iterator hint, const T & t, bool keepUnique)
+{
+    return emplaceHint(std::true_type(), hint.pNode, keepUnique, t);
+}
 
-        else
-        {
-            BNode* pIOS = it.pNode->pRight;
-            while (pIOS->pLeft != nullptr)
-                pIOS = pIOS->pLeft;
+template <typename T, typename Compare, typename Allocator, bool isCounted>
+typename BST <T, Compare, Allocator, isCounted> :: iterator BST <T, Compare, Allocator, isCounted> :: insert(iterator hint, T && t, bool keepUnique)
+{
+    return emplaceHint(std::true_type(), hint.pNode, keepUnique, std::move(t));
+}
 
-            pIOS->pLeft = it.pNode->pLeft;
-            if (it.pNode->pLeft)
-                it.pNode->pLeft->pParent = pIOS;
+/*****************************************************
+ * BST :: INSERT a RANGE
+ * Insert a whole batch at once: build the new nodes,
+ * sort them, and merge them into the tree in one walk
+ * (see INSERT BATCH). A batch of k costs
+ * O(k log(n/k + 1)) instead of k separate descents,
+ * and rebalancing happens once per subtree as it is
+ * joined back up rather than once per element. Equal
+ * elements end up after those already there, as with
+ * INSERT; keepUnique keeps only the first of each
+ ****************************************************/
+template <typename T, typename Compare, typename Allocator, bool isCounted>
+template <typename InputIt, typename>
+void BST <T, Compare, Allocator, isCounted> :: insert(InputIt first, InputIt last, bool keepUnique)
+{
+    std::vector<BNode *> batch;
+    try
+    {
+        for (; first != last; ++first)
+            batch.push_back(newNode(*first));
+        std::stable_sort(batch.begin(), batch.end(),
+                         [this](const BNode * lhs, const BNode * rhs) { return this->isLess(lhs->data, rhs->data); });
+    }
+    catch (...)
+    {
+        for (BNode* p : batch)
+            deleteNode(p);
+        throw;
+    }
 
-            if (it.pNode->pRight != pIOS)
-            {
-                if (pIOS->pRight)
-                    pIOS->pRight->pParent = pIOS->pParent;
-                pIOS->pParent->pLeft = pIOS->pRight;
-                pIOS->pRight = it.pNode->pRight;
-                it.pNode->pRight->pParent = pIOS;
-            }
+    // duplicates within the batch
+    std::vector<BNode *> rejected;
+    if (keepUnique && !batch.empty())
+    {
+        size_t numKept = 1;
+        for (size_t i = 1; i < batch.size(); i++)
+            if (this->isLess(batch[numKept - 1]->data, batch[i]->data))
+                batch[numKept++] = batch[i];
+            else
+                rejected.push_back(batch[i]);
+        batch.resize(numKept);
+    }
 
-            pIOS->pParent = it.pNode->pParent;
-            if (it.pNode->pParent && it.pNode->pParent->pLeft == it.pNode)
-                it.pNode->pParent->pLeft = pIOS;
-            if (it.pNode->pParent && it.pNode->pParent->pRight == it.pNode)
-                it.pNode->pParent->pRight = pIOS;
+    size_t numRejected = rejected.size();
+    size_t height;
+    root = insertBatch(root, blackHeight(root), batch.data(), batch.size(), keepUnique, rejected, height);
+    findEnds();
+    numElements += batch.size() - (rejected.size() - numRejected);
+    for (BNode* p : rejected)
+        deleteNode(p);
+}
 
-            if (root == it.pNode)
-                root = pIOS;
+/*****************************************************
+ * BST :: INSERT BATCH
+ * Merge num sorted detached nodes into the subtree under
+ * pNode (black, of the given black height) and return
+ * the new subtree with its black height. pNode's children
+ * are cut loose, the batch is cut at pNode's key, each
+ * half goes into its side, and pNode joins the two back
+ * up. Only subtrees that get something new are visited;
+ * whatever lands in an empty spot is linked up balanced
+ ****************************************************/
+template <typename T, typename Compare, typename Allocator, bool isCounted>
+typename BST <T, Compare, Allocator, isCounted> :: BNode * BST <T, Compare, Allocator, isCounted> :: insertBatch(BNode * pNode, size_t height,
+                                                                                                                    BNode * const * pBatch, size_t num, bool keepUnique,
+                                                                                                                    std::vector<BNode *> & rejected, size_t & heightResult)
+{
+    if (num == 0)
+    {
+        heightResult = height;
+        return pNode;
+    }
+    if (pNode == nullptr)
+    {
+        BNode* pNew = linkBalanced(pBatch, num, 0, redDepth(num), 1);
+        heightResult = blackHeight(pNew);
+        return pNew;
+    }
 
-            returnIt = iterator(pIOS);
+    // each child becomes a tree of its own, with a black root
+    BNode* pChildren[2] = { pNode->pLeft, pNode->pRight };
+    size_t heights[2] = { height - 1, height - 1 };
+    for (int i = 0; i < 2; i++)
+        if (pChildren[i])
+        {
+            pChildren[i]->pParent = nullptr;
+            if (pChildren[i]->isRed)
+            {
+                pChildren[i]->isRed = false;
+                heights[i]++;
+            }
         }
-        numElements--;
+
+    // less than pNode goes left; equal goes right, or nowhere if unique
+    BNode* const* pEqual = std::lower_bound(pBatch, pBatch + num, pNode->data,
+                                            [this](const BNode * p, const T & t) { return this->isLess(p->data, t); });
+    BNode* const* pGreater = pEqual;
+    if (keepUnique)
+    {
+        pGreater = std::upper_bound(pEqual, pBatch + num, pNode->data,
+                                    [this](const T & t, const BNode * p) { return this->isLess(t, p->data); });
+        rejected.insert(rejected.end(), pEqual, pGreater);
     }
- 
-    return returnIt;
-}
 
+    size_t heightLeft;
+    size_t heightRight;
+    BNode* pLeft  = insertBatch(pChildren[0], heights[0], pBatch, pEqual - pBatch, keepUnique, rejected, heightLeft);
+    BNode* pRight = insertBatch(pChildren[1], heights[1], pGreater, pBatch + num - pGreater, keepUnique, rejected, heightRight);
+    return join(pLeft, heightLeft, pNode, pRight, heightRight, heightResult);
+}
 
 /*****************************************************
- * BST :: CLEAR
- * Removes all the BNodes from a tree
+ * BST :: EMPLACE HINT
+ * The hinted versions of EMPLACE NODE
  ****************************************************/
-template <typename T>
-void BST <T> ::clear() noexcept
+template <typename T, typename Compare, typename Allocator, bool isCounted>
+template <typename Arg>
+typename BST <T, Compare, Allocator, isCounted> :: iterator BST <T, Compare, Allocator, isCounted> :: emplaceHint(std::true_type, BNode * pHint, bool keepUnique, Arg && t)
 {
-    clear(root);
-    root = nullptr;
-    numElements = 0;
+    bool isLeft = false;
+    BNode* pParent = nullptr;
+    BNode* pMatch = findParent(pHint, t, keepUnique, pParent, isLeft);
+    if (pMatch)
+        return iterator(pMatch, this);
+
+    BNode* pNew = newNode(std::forward<Arg>(t));
+    link(pNew, pParent, isLeft);
+    return iterator(pNew, this);
 }
 
+template <typename T, typename Compare, typename Allocator, bool isCounted>
+template <typename ... Args>
+typename BST <T, Compare, Allocator, isCounted> :: iterator BST <T, Compare, Allocator, isCounted> :: emplaceHint(std::false_type, BNode * pHint, bool keepUnique, Args && ... args)
+{
+    BNode* pNew = newNode(typename BNode::InPlace(), std::forward<Args>(args)...);
+    bool isLeft = false;
+    BNode* pParent = nullptr;
+    findParent(pHint, pNew->data, false, pParent, isLeft);
+    link(pNew, pParent, isLeft);
+    return iterator(pNew, this);
+}
 
 /*****************************************************
-    * BST :: CLEAR (RECURSIVE)
-    * Removes all the BNodes from a tree
-    ****************************************************/
-   template <typename T>
-   void BST <T> ::clear(BNode*& pThis)
-   {
-      if (!pThis)
-         return;
-
-      clear(pThis->pLeft);
-      clear(pThis->pRight);
-      delete pThis;
-      pThis = nullptr;
-      numElements--;
-   }
+ * BST :: EMPLACE NODE
+ * We already have a T: find where it goes first, then
+ * copy or move it straight into a new node. Nothing is
+ * allocated when keepUnique turns up a match
+ ****************************************************/
+template <typename T, typename Compare, typename Allocator, bool isCounted>
+template <typename Arg>
+std::pair<typename BST <T, Compare, Allocator, isCounted> :: iterator, bool> BST <T, Compare, Allocator, isCounted> :: emplaceNode(std::true_type, bool keepUnique, Arg && t)
+{
+    // find where it goes, bailing out if it is already there
+    bool isLeft = false;
+    BNode* pParent = nullptr;
+    BNode* pMatch = findParent(t, keepUnique, pParent, isLeft);
+    if (pMatch)
+        return std::pair<iterator, bool>(iterator(pMatch, this), false);
+
+    // hang the new node off the leaf we landed on
+    BNode* pNew = newNode(std::forward<Arg>(t));
+    link(pNew, pParent, isLeft);
+    return std::pair<iterator, bool>(iterator(pNew, this), true);
+}
+
+/*****************************************************
+ * BST :: EMPLACE NODE
+ * We only have constructor arguments. Normally the T is
+ * built in place in the new node and then we look for
+ * where the node goes. When keepUnique is set we build
+ * the T on the stack instead, so a duplicate never costs
+ * a node, and move it in once we know it is wanted
+ ****************************************************/
+template <typename T, typename Compare, typename Allocator, bool isCounted>
+template <typename ... Args>
+std::pair<typename BST <T, Compare, Allocator, isCounted> :: iterator, bool> BST <T, Compare, Allocator, isCounted> :: emplaceNode(std::false_type, bool keepUnique, Args && ... args)
+{
+    if (keepUnique)
+        return emplaceNode(std::true_type(), true, T(std::forward<Args>(args)...));
+
+    BNode* pNew = newNode(typename BNode::InPlace(), std::forward<Args>(args)...);
+    bool isLeft = false;
+    BNode* pParent = nullptr;
+    findParent(pNew->data, false, pParent, isLeft);
+    link(pNew, pParent, isLeft);
+    return std::pair<iterator, bool>(iterator(pNew, this), true);
+}
+
+/*****************************************************
+ * BST :: FIND PARENT
+ * Walk from the root down to the leaf where t belongs using
+ * one comparison per level. Equal elements go to the right.
+ * pParent is the node to hang t from (nullptr when the tree is
+ * empty) and isLeft says which side. When keepUnique is set,
+ * return the node already holding t, otherwise nullptr
+ ****************************************************/
+template <typename T, typename Compare, typename Allocator, bool isCounted>
+typename BST <T, Compare, Allocator, isCounted> :: BNode * BST <T, Compare, Allocator, isCounted> :: findParent(const T & t, bool keepUnique,
+                                               BNode * & pParent, bool & isLeft) const
+{
+    // the last node where we went right is the largest one <= t,
+    // so it is the only one that could be a duplicate
+    BNode* pCandidate = nullptr;
+    pParent = nullptr;
+    isLeft = false;
+    for (BNode* p = root; p; p = (isLeft ? p->pLeft : p->pRight))
+    {
+        pParent = p;
+        isLeft = this->isLess(t, p->data);
+        if (!isLeft)
+            pCandidate = p;
+    }
+
+    if (keepUnique && pCandidate && !this->isLess(pCandidate->data, t))
+        return pCandidate;
+    return nullptr;
+}
+
+/*****************************************************
+ * BST :: FIND PARENT with a HINT
+ * Like FIND PARENT, but first see if t belongs right next
+ * to pHint: just before it (between it and its predecessor)
+ * or just after it (between it and its successor). A null
+ * hint means the end, so appending sorted data costs one
+ * comparison per element. If the hint is wrong, fall back
+ * to walking down from the root
+ ****************************************************/
+template <typename T, typename Compare, typename Allocator, bool isCounted>
+typename BST <T, Compare, Allocator, isCounted> :: BNode * BST <T, Compare, Allocator, isCounted> :: findParent(BNode * pHint, const T & t, bool keepUnique,
+                                                                                          BNode * & pParent, bool & isLeft) const
+{
+    // t would go between these two (nullptr meaning the front or back)
+    BNode* pBefore;
+    BNode* pAfter;
+    bool fits;
+    if (pHint && !this->isLess(pHint->data, t))
+    {
+        // t <= hint: try just before the hint
+        pBefore = BNode::prev(pHint);
+        pAfter  = pHint;
+        fits = !pBefore || !this->isLess(t, pBefore->data);
+    }
+    else if (pHint)
+    {
+        // hint < t: try just after the hint
+        pBefore = pHint;
+        pAfter  = BNode::next(pHint);
+        fits = !pAfter || !this->isLess(pAfter->data, t);
+    }
+    else
+    {
+        // end(): try after the last element
+        pBefore = lastNode();
+        pAfter  = nullptr;
+        fits = !pBefore || !this->isLess(t, pBefore->data);
+    }
+
+    if (!fits)
+        return findParent(t, keepUnique, pParent, isLeft);
+
+    // either neighbour could be equal to t
+    if (keepUnique)
+    {
+        if (pBefore && !this->isLess(pBefore->data, t))
+            return pBefore;
+        if (pAfter && !this->isLess(t, pAfter->data))
+            return pAfter;
+    }
+
+    // the gap between two neighbours is always an empty child of one of them
+    if (pAfter && pAfter->pLeft == nullptr)
+    {
+        pParent = pAfter;
+        isLeft = true;
+    }
+    else
+    {
+        pParent = pBefore;
+        isLeft = false;
+    }
+    return nullptr;
+}
+
+/*****************************************************
+ * BST :: LINK
+ * Attach a new leaf to pParent, or make it the root,
+ * then rebalance
+ ****************************************************/
+template <typename T, typename Compare, typename Allocator, bool isCounted>
+void BST <T, Compare, Allocator, isCounted> :: link(BNode * pNew, BNode * pParent, bool isLeft)
+{
+    if (pParent == nullptr)
+        root = pFirst = pLast = pNew;
+    else if (isLeft)
+    {
+        pParent->addLeft(pNew);
+        if (pParent == pFirst)
+            pFirst = pNew;
+    }
+    else
+    {
+        pParent->addRight(pNew);
+        if (pParent == pLast)
+            pLast = pNew;
+    }
+    numElements++;
+
+    // every node above the new leaf has one more below it
+    if (isCounted)
+        for (BNode* p = pParent; p; p = p->pParent)
+            p->setCount(p->getCount() + 1);
+
+    insertFixup(root, pNew);
+}
+
+/*************************************************
+ * BST :: ERASE
+ * Remove a given node as specified by the iterator
+ * and return an iterator to the element after it
+ ************************************************/
+template <typename T, typename Compare, typename Allocator, bool isCounted>
+typename BST <T, Compare, Allocator, isCounted> ::iterator BST <T, Compare, Allocator, isCounted> :: erase(iterator & it)
+{  
+    if (it == end())
+        return end();
+
+    BNode* pDelete = it.pNode;
+    iterator itNext(unlink(pDelete), this);
+    deleteNode(pDelete);
+    return itNext;
+}
+
+/*************************************************
+ * BST :: ERASE a RANGE
+ * Remove [first, last) and return last. Rather than
+ * erasing one node at a time, cut the tree just before
+ * first and just before last, free the middle piece in
+ * one sweep, and join the outer pieces back up.
+ * Joining needs a middle node, so we borrow the root of
+ * the doomed piece and unlink it afterwards, one
+ * ordinary erase. O(k + log n) for k elements
+ ************************************************/
+template <typename T, typename Compare, typename Allocator, bool isCounted>
+typename BST <T, Compare, Allocator, isCounted> ::iterator BST <T, Compare, Allocator, isCounted> :: erase(iterator first, iterator last)
+{
+    if (first == last)
+        return last;
+    if (first.pNode == firstNode() && last == end())
+    {
+        clear();
+        return end();
+    }
+
+    size_t numErase = 0;
+    for (iterator it = first; it != last; ++it)
+        numErase++;
+
+    BNode* pLeft;
+    BNode* pMiddle;
+    BNode* pRight;
+    size_t heightLeft;
+    size_t heightMiddle;
+    size_t heightRight;
+    splitAt(root, blackHeight(root), first.pNode, pLeft, heightLeft, pMiddle, heightMiddle);
+    if (last.pNode)
+        splitAt(pMiddle, heightMiddle, last.pNode, pMiddle, heightMiddle, pRight, heightRight);
+    else
+    {
+        pRight = nullptr;
+        heightRight = 0;
+    }
+
+    // the middle piece goes, all but its root
+    BNode* pBorrow = pMiddle;
+    clear(pBorrow->pLeft);
+    clear(pBorrow->pRight);
+
+    if (pLeft == nullptr || pRight == nullptr)
+    {
+        root = pLeft ? pLeft : pRight;
+        if (root)
+            root->pParent = nullptr;
+        deleteNode(pBorrow);
+        numElements -= numErase;
+    }
+    else
+    {
+        size_t heightRoot;
+        root = join(pLeft, heightLeft, pBorrow, pRight, heightRight, heightRoot);
+        numElements -= numErase - 1;
+        unlink(pBorrow);
+        deleteNode(pBorrow);
+    }
+    findEnds();
+    return last;
+}
+
+/*************************************************
+ * BST :: ERASE RANGE
+ * Remove every element from lo up to but not
+ * including hi, and say how many there were
+ ************************************************/
+template <typename T, typename Compare, typename Allocator, bool isCounted>
+size_t BST <T, Compare, Allocator, isCounted> :: erase_range(const T & lo, const T & hi)
+{
+    if (!this->isLess(lo, hi))
+        return 0;
+
+    size_t numBefore = numElements;
+    erase(iterator(lowerBound(lo), this), iterator(lowerBound(hi), this));
+    return numBefore - numElements;
+}
+
+/*************************************************
+ * BST :: UNLINK
+ * Take pDelete out of the tree without freeing it,
+ * rebalance, and return the node that came after it
+ ************************************************/
+template <typename T, typename Compare, typename Allocator, bool isCounted>
+typename BST <T, Compare, Allocator, isCounted> :: BNode * BST <T, Compare, Allocator, isCounted> :: unlink(BNode * pDelete)
+{
+    BNode* pNext = BNode::next(pDelete);
+
+    // keep the cached ends pointing at nodes still in the tree
+    if (pDelete == pFirst)
+        pFirst = pNext;
+    if (pDelete == pLast)
+        pLast = BNode::prev(pDelete);
+
+    // pChild moves up into the spot vacated in the tree (it may be
+    // nullptr, so we also track its parent for the fixup)
+    BNode* pChild;
+    BNode* pChildParent;
+    bool removedRed = pDelete->isRed;
+
+    // zero or one child: splice the child into our spot
+    if (pDelete->pLeft == nullptr || pDelete->pRight == nullptr)
+    {
+        pChild = pDelete->pLeft ? pDelete->pLeft : pDelete->pRight;
+        pChildParent = pDelete->pParent;
+        replace(root, pDelete, pChild);
+    }
+    // two children: the in-order successor takes our place and color
+    else
+    {
+        BNode* pIOS = pNext;
+        removedRed = pIOS->isRed;
+        pChild = pIOS->pRight;
+        if (pIOS->pParent == pDelete)
+            pChildParent = pIOS;
+        else
+        {
+            pChildParent = pIOS->pParent;
+            replace(root, pIOS, pIOS->pRight);
+            pIOS->addRight(pDelete->pRight);
+        }
+        replace(root, pDelete, pIOS);
+        pIOS->addLeft(pDelete->pLeft);
+        pIOS->isRed = pDelete->isRed;
+    }
+
+    // everything from where a node came out up to the root is one
+    // smaller, and the successor has new children to add up
+    if (isCounted)
+        for (BNode* p = pChildParent; p; p = p->pParent)
+            p->recount();
+
+    // taking out a black node shortens one path
+    if (!removedRed)
+        eraseFixup(pChild, pChildParent);
+
+    numElements--;
+    return pNext;
+}
+
+/*************************************************
+ * BST :: MERGE
+ * Move every element of rhs into this tree by relinking
+ * its nodes: nothing is allocated or copied. An empty
+ * tree takes all of rhs in O(1), and when all of rhs
+ * sorts after (or before) all of this tree, the two are
+ * concatenated in O(log n). With keepUnique, elements
+ * we already have stay behind in rhs, including the
+ * second of two equal elements in rhs; only an rhs
+ * without equal neighbours can then move in one piece,
+ * which takes a walk over rhs to find out. Trees that do
+ * not share a pool (see PoolAllocator) move the values
+ * into new nodes instead
+ ************************************************/
+template <typename T, typename Compare, typename Allocator, bool isCounted>
+void BST <T, Compare, Allocator, isCounted> :: merge(BST & rhs, bool keepUnique)
+{
+    if (this == &rhs || rhs.root == nullptr)
+        return;
+    bool isSameAlloc = nodeAlloc() == rhs.nodeAlloc();
+
+    // rhs moves as a whole only if none of it would stay behind
+    bool isWhole = isSameAlloc;
+    if (isWhole && keepUnique)
+        for (BNode* p = rhs.pFirst; isWhole && p != rhs.pLast; p = BNode::next(p))
+            isWhole = this->isLess(p->data, BNode::next(p)->data);
+
+    // nothing here yet: take their nodes, leave them ours (none)
+    if (isWhole && root == nullptr)
+    {
+        std::swap(root, rhs.root);
+        std::swap(pFirst, rhs.pFirst);
+        std::swap(pLast, rhs.pLast);
+        std::swap(numElements, rhs.numElements);
+        return;
+    }
+
+    // ranges that do not overlap: one of the ends becomes the pivot
+    // that joins the two trees together
+    if (isWhole)
+    {
+        BNode* pLow  = rhs.firstNode();
+        BNode* pHigh = rhs.lastNode();
+        bool isAfter  = keepUnique ? this->isLess(lastNode()->data, pLow->data)
+                                   : !this->isLess(pLow->data, lastNode()->data);
+        bool isBefore = !isAfter && this->isLess(pHigh->data, firstNode()->data);
+        if (isAfter || isBefore)
+        {
+            BNode* pMid = isAfter ? pLow : pHigh;
+            BNode* pFirstNew = isAfter ? pFirst : rhs.pFirst;
+            BNode* pLastNew  = isAfter ? rhs.pLast : pLast;
+            rhs.unlink(pMid);
+            size_t numMoved = rhs.numElements + 1;
+            size_t heightRoot;
+            if (isAfter)
+                root = join(root, blackHeight(root), pMid, rhs.root, blackHeight(rhs.root), heightRoot);
+            else
+                root = join(rhs.root, blackHeight(rhs.root), pMid, root, blackHeight(root), heightRoot);
+            pFirst = pFirstNew;
+            pLast = pLastNew;
+            numElements += numMoved;
+            rhs.root = rhs.pFirst = rhs.pLast = nullptr;
+            rhs.numElements = 0;
+            return;
+        }
+    }
+
+    // otherwise one node at a time
+    for (BNode* p = rhs.firstNode(); p; )
+    {
+        BNode* pParent;
+        bool isLeft;
+        if (findParent(p->data, keepUnique, pParent, isLeft))
+        {
+            p = BNode::next(p);
+            continue;
+        }
+
+        BNode* pNew = isSameAlloc ? p : newNode(std::move(p->data));
+        BNode* pNext = rhs.unlink(p);
+        if (isSameAlloc)
+        {
+            pNew->pLeft = pNew->pRight = pNew->pParent = nullptr;
+            pNew->isRed = true;
+            pNew->setCount(1);
+        }
+        else
+            rhs.deleteNode(p);
+        link(pNew, pParent, isLeft);
+        p = pNext;
+    }
+}
+
+/*************************************************
+ * BST :: JOIN two trees
+ * One tree holding lhs and then rhs, where nothing in
+ * rhs sorts before anything in lhs. The result takes
+ * over lhs (and its allocator) and merges rhs in, which
+ * is an O(log n) concatenation when the order holds.
+ * Like SPLIT, only an order-statistics tree offers it
+ ************************************************/
+template <typename T, typename Compare, typename Allocator, bool isCounted>
+BST <T, Compare, Allocator, isCounted> BST <T, Compare, Allocator, isCounted> :: join(BST && lhs, BST && rhs)
+{
+    static_assert(isCounted, "join() needs a BST with isCounted set");
+    BST result(std::move(lhs));
+    result.merge(rhs);
+    return result;
+}
+
+/*************************************************
+ * BST :: SET OPERATION
+ * Line both trees up in order, a subtree per thread,
+ * and build the result from copies of the nodes the
+ * operation keeps: one copy per element kept
+ ************************************************/
+template <typename T, typename Compare, typename Allocator, bool isCounted>
+BST <T, Compare, Allocator, isCounted> BST <T, Compare, Allocator, isCounted> :: setOperation(const BST & lhs, const BST & rhs,
+                                                                                            int keep, unsigned numThreads)
+{
+    numThreads = threadCount(numThreads, lhs.size() + rhs.size());
+    BST result(lhs.key_comp(), NodeTraits::select_on_container_copy_construction(lhs.nodeAlloc()));
+    std::vector<BNode *> left;
+    std::vector<BNode *> right;
+    lhs.flatten(left, numThreads);
+    rhs.flatten(right, numThreads);
+
+    std::mutex lockAlloc;
+    size_t height;
+    result.root = result.copySet(left.data(), left.size(), right.data(), right.size(), keep, numThreads,
+                                 lockAlloc, height, result.numElements);
+    result.findEnds();
+    return result;
+}
+
+/*************************************************
+ * BST :: SET OPERATION - move in
+ * Same thing, but both trees are taken apart and the
+ * nodes kept are relinked into the result; the rest
+ * are freed. Nothing is allocated or copied, unless
+ * the two trees do not share a pool (see PoolAllocator)
+ ************************************************/
+template <typename T, typename Compare, typename Allocator, bool isCounted>
+BST <T, Compare, Allocator, isCounted> BST <T, Compare, Allocator, isCounted> :: setOperation(BST && lhs, BST && rhs,
+                                                                                            int keep, unsigned numThreads)
+{
+    if (!(lhs.nodeAlloc() == rhs.nodeAlloc()))
+        return setOperation(static_cast<const BST &>(lhs), static_cast<const BST &>(rhs), keep, numThreads);
+
+    // nothing can fail from here on
+    numThreads = threadCount(numThreads, lhs.size() + rhs.size());
+    BST result(std::move(lhs));
+    BNode* pLeft = result.root;
+    BNode* pRight = rhs.root;
+    for (BST* pTree : { &result, &rhs })
+    {
+        pTree->root = pTree->pFirst = pTree->pLast = nullptr;
+        pTree->numElements = 0;
+    }
+
+    std::mutex lockAlloc;
+    size_t height;
+    result.root = result.moveSet(pLeft, blackHeight(pLeft), pRight, blackHeight(pRight), keep, numThreads,
+                                 lockAlloc, height, result.numElements);
+    result.findEnds();
+    return result;
+}
+
+/*************************************************
+ * BST :: COPY SET
+ * The operation on two sorted runs of nodes, as a new
+ * tree of copies, with its black height and size. Both
+ * runs are cut around the middle element of the longer
+ * one: the parts before it and the parts after it are
+ * done side by side, the elements equal to it here,
+ * and the three are joined back up. Each run of equal
+ * elements stays in one piece and pairs off just as it
+ * would in one long merge. On failure nothing is left
+ ************************************************/
+template <typename T, typename Compare, typename Allocator, bool isCounted>
+typename BST <T, Compare, Allocator, isCounted> :: BNode * BST <T, Compare, Allocator, isCounted> :: copySet(BNode * const * pLeft, size_t numLeft,
+                                                                                                             BNode * const * pRight, size_t numRight,
+                                                                                                             int keep, unsigned numThreads, std::mutex & lockAlloc,
+                                                                                                             size_t & height, size_t & num)
+{
+    if (numThreads <= 1)
+    {
+        BNode* pRun = copyRun(pLeft, numLeft, pRight, numRight, keep, lockAlloc, num);
+        return joinRun(nullptr, 0, pRun, num, nullptr, 0, height);
+    }
+
+    const T & key = (numLeft >= numRight ? pLeft[numLeft / 2] : pRight[numRight / 2])->data;
+    auto isBefore = [this](const BNode * p, const T & t) { return this->isLess(p->data, t); };
+    auto isAfter  = [this](const T & t, const BNode * p) { return this->isLess(t, p->data); };
+    BNode * const * cuts[2][2] =
+    {
+        { std::lower_bound(pLeft,  pLeft  + numLeft,  key, isBefore), std::upper_bound(pLeft,  pLeft  + numLeft,  key, isAfter) },
+        { std::lower_bound(pRight, pRight + numRight, key, isBefore), std::upper_bound(pRight, pRight + numRight, key, isAfter) }
+    };
+
+    BNode* pBefore = nullptr;
+    BNode* pAfter = nullptr;
+    BNode* pRun = nullptr;
+    size_t heightBefore = 0;
+    size_t heightAfter = 0;
+    size_t numBefore = 0;
+    size_t numAfter = 0;
+    size_t numRun = 0;
+    WorkerPool::Group parts;
+    parts.run([&]()
+    {
+        pBefore = copySet(pLeft, cuts[0][0] - pLeft, pRight, cuts[1][0] - pRight, keep, numThreads / 2,
+                          lockAlloc, heightBefore, numBefore);
+    });
+    parts.call([&]()
+    {
+        pAfter = copySet(cuts[0][1], pLeft + numLeft - cuts[0][1], cuts[1][1], pRight + numRight - cuts[1][1], keep,
+                         numThreads - numThreads / 2, lockAlloc, heightAfter, numAfter);
+    });
+    parts.call([&]()
+    {
+        pRun = copyRun(cuts[0][0], cuts[0][1] - cuts[0][0], cuts[1][0], cuts[1][1] - cuts[1][0], keep, lockAlloc, numRun);
+    });
+    try
+    {
+        parts.wait();
+    }
+    catch (...)
+    {
+        deleteRun(toRun(pBefore, nullptr), lockAlloc);
+        deleteRun(toRun(pAfter, nullptr), lockAlloc);
+        deleteRun(pRun, lockAlloc);
+        throw;
+    }
+
+    num = numBefore + numRun + numAfter;
+    return joinRun(pBefore, heightBefore, pRun, numRun, pAfter, heightAfter, height);
+}
+
+/*************************************************
+ * BST :: COPY RUN
+ * Merge two short sorted runs of nodes and copy the
+ * ones kept, giving a run of new nodes
+ ************************************************/
+template <typename T, typename Compare, typename Allocator, bool isCounted>
+typename BST <T, Compare, Allocator, isCounted> :: BNode * BST <T, Compare, Allocator, isCounted> :: copyRun(BNode * const * pLeft, size_t numLeft,
+                                                                                                             BNode * const * pRight, size_t numRight,
+                                                                                                             int keep, std::mutex & lockAlloc, size_t & num)
+{
+    std::vector<const BNode *> kept;
+    mergeSequences(pLeft, pLeft + numLeft, pRight, pRight + numRight, keep,
+                   [&kept](const BNode * p, bool isKept) { if (isKept) kept.push_back(p); });
+
+    std::vector<BNode *> nodes;
+    copyNodes(nodes, kept.size(), [&kept](size_t i) -> const T & { return kept[i]->data; }, 1, lockAlloc);
+    num = nodes.size();
+    for (size_t i = 1; i < num; i++)
+        nodes[i - 1]->pRight = nodes[i];
+    if (num == 0)
+        return nullptr;
+    nodes[num - 1]->pRight = nullptr;
+    return nodes[0];
+}
+
+/*************************************************
+ * BST :: MOVE SET
+ * COPY SET for two trees we own, each black rooted
+ * and of the given black height. The trees are split
+ * around the root of the taller one into the parts
+ * before it, equal to it and after it, and the nodes
+ * kept are relinked rather than copied. Cannot fail
+ ************************************************/
+template <typename T, typename Compare, typename Allocator, bool isCounted>
+typename BST <T, Compare, Allocator, isCounted> :: BNode * BST <T, Compare, Allocator, isCounted> :: moveSet(BNode * pLeft, size_t heightLeft,
+                                                                                                             BNode * pRight, size_t heightRight,
+                                                                                                             int keep, unsigned numThreads, std::mutex & lockAlloc,
+                                                                                                             size_t & height, size_t & num)
+{
+    if (numThreads <= 1 || (pLeft == nullptr && pRight == nullptr))
+    {
+        BNode* pRun = moveRun(pLeft, pRight, keep, lockAlloc, num);
+        return joinRun(nullptr, 0, pRun, num, nullptr, 0, height);
+    }
+
+    const T & key = (heightLeft >= heightRight ? pLeft : pRight)->data;
+    auto isBefore   = [this, &key](const BNode * p) { return this->isLess(p->data, key); };
+    auto isNotAfter = [this, &key](const BNode * p) { return !this->isLess(key, p->data); };
+    BNode* pieces[2][3];
+    size_t heights[2][3];
+    BNode* trees[2] = { pLeft, pRight };
+    size_t heightsTree[2] = { heightLeft, heightRight };
+    for (int i = 0; i < 2; i++)
+    {
+        BNode* pRest;
+        size_t heightRest;
+        splitNode(trees[i], heightsTree[i], isBefore, pieces[i][0], heights[i][0], pRest, heightRest);
+        splitNode(pRest, heightRest, isNotAfter, pieces[i][1], heights[i][1], pieces[i][2], heights[i][2]);
+    }
+
+    BNode* pBefore;
+    BNode* pAfter;
+    BNode* pRun;
+    size_t heightBefore;
+    size_t heightAfter;
+    size_t numBefore;
+    size_t numAfter;
+    size_t numRun;
+    WorkerPool::Group parts;
+    parts.run([&]()
+    {
+        pBefore = moveSet(pieces[0][0], heights[0][0], pieces[1][0], heights[1][0], keep, numThreads / 2,
+                          lockAlloc, heightBefore, numBefore);
+    });
+    parts.call([&]()
+    {
+        pAfter = moveSet(pieces[0][2], heights[0][2], pieces[1][2], heights[1][2], keep, numThreads - numThreads / 2,
+                         lockAlloc, heightAfter, numAfter);
+    });
+    pRun = moveRun(pieces[0][1], pieces[1][1], keep, lockAlloc, numRun);
+    parts.wait();
+
+    num = numBefore + numRun + numAfter;
+    return joinRun(pBefore, heightBefore, pRun, numRun, pAfter, heightAfter, height);
+}
+
+/*************************************************
+ * BST :: MOVE RUN
+ * Take two small trees apart into runs, merge them,
+ * and free the nodes not kept, giving a run of the rest
+ ************************************************/
+template <typename T, typename Compare, typename Allocator, bool isCounted>
+typename BST <T, Compare, Allocator, isCounted> :: BNode * BST <T, Compare, Allocator, isCounted> :: moveRun(BNode * pLeft, BNode * pRight, int keep,
+                                                                                                             std::mutex & lockAlloc, size_t & num)
+{
+    BNode* pRun = nullptr;
+    BNode** ppTail = &pRun;
+    num = 0;
+    RunIterator itLeft = { toRun(pLeft, nullptr) };
+    RunIterator itRight = { toRun(pRight, nullptr) };
+    RunIterator itEnd = { nullptr };
+    mergeSequences(itLeft, itEnd, itRight, itEnd, keep, [&](BNode * p, bool isKept)
+    {
+        if (isKept)
+        {
+            *ppTail = p;
+            ppTail = &p->pRight;
+            num++;
+        }
+        else
+            deleteNode(p, lockAlloc);
+    });
+    *ppTail = nullptr;
+    return pRun;
+}
+
+/*************************************************
+ * BST :: MERGE SEQUENCES
+ * Walk two sorted runs of nodes together and hand
+ * every node to sort(), saying whether the operation
+ * keeps it. Equal elements pair off one for one, as
+ * in the standard algorithms, and the right one is
+ * dropped. A node is passed on only after we have
+ * moved past it, so sort() may relink it
+ ************************************************/
+template <typename T, typename Compare, typename Allocator, bool isCounted>
+template <typename It, typename Sort>
+void BST <T, Compare, Allocator, isCounted> :: mergeSequences(It itLeft, It endLeft, It itRight, It endRight, int keep,
+                                                              Sort sort) const
+{
+    while (itLeft != endLeft && itRight != endRight)
+    {
+        if (this->isLess((*itLeft)->data, (*itRight)->data))
+            sort(*itLeft++, (keep & KEEP_LEFT) != 0);
+        else if (this->isLess((*itRight)->data, (*itLeft)->data))
+            sort(*itRight++, (keep & KEEP_RIGHT) != 0);
+        else
+        {
+            sort(*itLeft++, (keep & KEEP_BOTH) != 0);
+            sort(*itRight++, false);
+        }
+    }
+    while (itLeft != endLeft)
+        sort(*itLeft++, (keep & KEEP_LEFT) != 0);
+    while (itRight != endRight)
+        sort(*itRight++, (keep & KEEP_RIGHT) != 0);
+}
+
+/*************************************************
+ * BST :: FLATTEN
+ * Every node, in order. The top few levels are taken
+ * a node at a time until there are subtrees enough to
+ * go round; then the subtrees are counted, to see where
+ * each one starts, and walked, both a thread apiece
+ ************************************************/
+template <typename T, typename Compare, typename Allocator, bool isCounted>
+void BST <T, Compare, Allocator, isCounted> :: flatten(std::vector<BNode *> & nodes, unsigned numThreads) const
+{
+    size_t depth = 2;
+    for (unsigned num = 1; num < numThreads; num *= 2)
+        depth++;
+    std::vector<std::pair<BNode *, bool> > tops;    // a node, or a whole subtree when true
+    findTops(root, depth, tops);
+
+    std::vector<size_t> starts(tops.size() + 1, 0);
+    parallelFor(tops.size(), numThreads, [&](size_t begin, size_t end)
+    {
+        for (size_t i = begin; i < end; i++)
+            starts[i + 1] = tops[i].second ? countNodes(tops[i].first) : 1;
+    });
+    for (size_t i = 0; i < tops.size(); i++)
+        starts[i + 1] += starts[i];
+
+    nodes.resize(starts.back());
+    parallelFor(tops.size(), numThreads, [&](size_t begin, size_t end)
+    {
+        for (size_t i = begin; i < end; i++)
+        {
+            BNode* p = tops[i].second ? BNode::first(tops[i].first) : tops[i].first;
+            for (size_t j = starts[i]; j < starts[i + 1]; j++, p = BNode::next(p))
+                nodes[j] = p;
+        }
+    });
+}
+
+/*************************************************
+ * BST :: FIND TOPS
+ * In order, the nodes less than depth levels down and
+ * the subtrees that hang below them
+ ************************************************/
+template <typename T, typename Compare, typename Allocator, bool isCounted>
+void BST <T, Compare, Allocator, isCounted> :: findTops(BNode * pNode, size_t depth, std::vector<std::pair<BNode *, bool> > & tops)
+{
+    if (pNode == nullptr)
+        return;
+    if (depth == 0)
+    {
+        tops.push_back(std::make_pair(pNode, true));
+        return;
+    }
+    findTops(pNode->pLeft, depth - 1, tops);
+    tops.push_back(std::make_pair(pNode, false));
+    findTops(pNode->pRight, depth - 1, tops);
+}
+
+/*************************************************
+ * BST :: COUNT NODES
+ * How many nodes are under pNode. An order-statistics
+ * tree knows; any other has to count them
+ ************************************************/
+template <typename T, typename Compare, typename Allocator, bool isCounted>
+size_t BST <T, Compare, Allocator, isCounted> :: countNodes(const BNode * pNode)
+{
+    if (isCounted || pNode == nullptr)
+        return BNode::countOf(pNode);
+    return 1 + countNodes(pNode->pLeft) + countNodes(pNode->pRight);
+}
+
+/*************************************************
+ * BST :: TO RUN
+ * Unlink the subtree under pNode into a run, in
+ * order, followed by pTail. Returns the first node
+ ************************************************/
+template <typename T, typename Compare, typename Allocator, bool isCounted>
+typename BST <T, Compare, Allocator, isCounted> :: BNode * BST <T, Compare, Allocator, isCounted> :: toRun(BNode * pNode, BNode * pTail)
+{
+    if (pNode == nullptr)
+        return pTail;
+    pNode->pRight = toRun(pNode->pRight, pTail);
+    return toRun(pNode->pLeft, pNode);
+}
+
+/*************************************************
+ * BST :: JOIN RUN
+ * One tree out of pLeft, then the numRun nodes of a
+ * run, then pRight, all in order, with its black
+ * height. JOIN needs a node in the middle: the first
+ * of the run, with the rest linked up balanced on its
+ * right; or, with no run, the first node of pRight,
+ * split off it
+ ************************************************/
+template <typename T, typename Compare, typename Allocator, bool isCounted>
+typename BST <T, Compare, Allocator, isCounted> :: BNode * BST <T, Compare, Allocator, isCounted> :: joinRun(BNode * pLeft, size_t heightLeft,
+                                                                                                             BNode * pRun, size_t numRun,
+                                                                                                             BNode * pRight, size_t heightRight,
+                                                                                                             size_t & height)
+{
+    if (numRun == 0)
+    {
+        if (pLeft == nullptr || pRight == nullptr)
+        {
+            height = pLeft ? heightLeft : heightRight;
+            return pLeft ? pLeft : pRight;
+        }
+        BNode* pFirst = BNode::first(pRight);
+        size_t heightFirst;
+        splitNode(pRight, heightRight, [pFirst](const BNode * p) { return p == pFirst; },
+                  pFirst, heightFirst, pRight, heightRight);
+        return join(pLeft, heightLeft, pFirst, pRight, heightRight, height);
+    }
+
+    BNode* pMid = pRun;
+    pRun = pRun->pRight;
+    auto next = [&pRun]()
+    {
+        BNode* p = pRun;
+        pRun = p->pRight;
+        return p;
+    };
+    BNode* pMiddle = buildBalanced(next, numRun - 1, 0, redDepth(numRun - 1));
+    if (pMiddle)
+        pMiddle->pParent = nullptr;
+    pLeft = join(pLeft, heightLeft, pMid, pMiddle, blackHeight(pMiddle), heightLeft);
+    return joinRun(pLeft, heightLeft, nullptr, 0, pRight, heightRight, height);
+}
+
+/*************************************************
+ * BST :: DELETE RUN
+ * Free every node in a run
+ ************************************************/
+template <typename T, typename Compare, typename Allocator, bool isCounted>
+void BST <T, Compare, Allocator, isCounted> :: deleteRun(BNode * pRun, std::mutex & lockAlloc)
+{
+    while (pRun)
+    {
+        BNode* p = pRun;
+        pRun = p->pRight;
+        deleteNode(p, lockAlloc);
+    }
+}
+
+/*************************************************
+ * BST :: THREAD COUNT
+ * How many threads to use on num elements when asked
+ * for numThreads: 0 means one for every core, and no
+ * thread gets less than MIN_PARALLEL elements
+ ************************************************/
+template <typename T, typename Compare, typename Allocator, bool isCounted>
+unsigned BST <T, Compare, Allocator, isCounted> :: threadCount(unsigned numThreads, size_t num)
+{
+    if (numThreads == 0)
+        numThreads = std::thread::hardware_concurrency();
+    return static_cast<unsigned>(std::max<size_t>(1, std::min<size_t>(numThreads, num / MIN_PARALLEL + 1)));
+}
+
+/*************************************************
+ * BST :: PARALLEL FOR
+ * Cut [0, num) into numThreads even blocks and call
+ * function(begin, end) on each, all at once, on the
+ * WORKER POOL. The first block runs on this thread.
+ * Waits for every block and then passes on the first
+ * exception, if any
+ ************************************************/
+template <typename T, typename Compare, typename Allocator, bool isCounted>
+template <typename Function>
+void BST <T, Compare, Allocator, isCounted> :: parallelFor(size_t num, unsigned numThreads, Function function)
+{
+    if (numThreads > num)
+        numThreads = static_cast<unsigned>(num);
+    if (numThreads <= 1)
+    {
+        function(0, num);
+        return;
+    }
+
+    WorkerPool::Group blocks;
+    for (unsigned i = 1; i < numThreads; i++)
+        blocks.run([&function, num, i, numThreads]() { function(num * i / numThreads, num * (i + 1) / numThreads); });
+    blocks.call([&function, num, numThreads]() { function(0, num / numThreads); });
+    blocks.wait();
+}
+
+/*************************************************
+ * BST :: PARALLEL SORT
+ * Stable sort: each thread sorts its own block, then
+ * neighbouring blocks are merged in pairs, round after
+ * round, until one block is left. The rounds go back
+ * and forth between the range and a buffer, and each
+ * one keeps every thread busy however few pairs are
+ * left (see MERGE ROUND)
+ ************************************************/
+template <typename T, typename Compare, typename Allocator, bool isCounted>
+template <typename RandomIt, typename Less>
+void BST <T, Compare, Allocator, isCounted> :: parallelSort(RandomIt first, RandomIt last, Less less, unsigned numThreads)
+{
+    size_t num = last - first;
+    std::vector<size_t> bounds(numThreads + 1);
+    for (size_t i = 0; i <= numThreads; i++)
+        bounds[i] = num * i / numThreads;
+
+    parallelFor(numThreads, numThreads, [&](size_t begin, size_t end)
+    {
+        for (size_t i = begin; i < end; i++)
+            std::stable_sort(first + bounds[i], first + bounds[i + 1], less);
+    });
+    if (numThreads <= 1)
+        return;
+
+    std::vector<typename std::iterator_traits<RandomIt>::value_type> buffer(num);
+    bool isInBuffer = false;
+    for (size_t width = 1; width < numThreads; width *= 2, isInBuffer = !isInBuffer)
+    {
+        if (isInBuffer)
+            mergeRound(buffer.begin(), first, bounds, width, less, numThreads);
+        else
+            mergeRound(first, buffer.begin(), bounds, width, less, numThreads);
+    }
+    if (isInBuffer)
+        parallelFor(num, numThreads, [&](size_t begin, size_t end)
+        {
+            std::copy(buffer.begin() + begin, buffer.begin() + end, first + begin);
+        });
+}
+
+/*************************************************
+ * BST :: MERGE ROUND
+ * Merge each pair of neighbouring runs of blocks, width
+ * blocks each, from one place to the same spot in
+ * another. Each merge gets its share of the threads:
+ * its output is cut into even slices, and where a slice
+ * starts in each run is found by CO RANK, so the slices
+ * merge on their own, side by side
+ ************************************************/
+template <typename T, typename Compare, typename Allocator, bool isCounted>
+template <typename From, typename To, typename Less>
+void BST <T, Compare, Allocator, isCounted> :: mergeRound(From from, To to, const std::vector<size_t> & bounds, size_t width,
+                                                          Less less, unsigned numThreads)
+{
+    size_t numMerges = (numThreads + 2 * width - 1) / (2 * width);
+    size_t numSlices = std::max<size_t>(1, numThreads / numMerges);
+    parallelFor(numMerges * numSlices, numThreads, [&](size_t begin, size_t end)
+    {
+        for (size_t task = begin; task < end; task++)
+        {
+            size_t block = 2 * width * (task / numSlices);
+            size_t lo  = bounds[block];
+            size_t mid = bounds[std::min<size_t>(block + width, numThreads)];
+            size_t hi  = bounds[std::min<size_t>(block + 2 * width, numThreads)];
+            size_t slice = task % numSlices;
+            size_t kBegin = (hi - lo) * slice / numSlices;
+            size_t kEnd   = (hi - lo) * (slice + 1) / numSlices;
+            size_t iBegin = coRank(from + lo, mid - lo, from + mid, hi - mid, kBegin, less);
+            size_t iEnd   = coRank(from + lo, mid - lo, from + mid, hi - mid, kEnd,   less);
+            std::merge(from + lo + iBegin,           from + lo + iEnd,
+                       from + mid + (kBegin - iBegin), from + mid + (kEnd - iEnd),
+                       to + lo + kBegin, less);
+        }
+    });
+}
+
+/*************************************************
+ * BST :: CO RANK
+ * How many of the first k elements of the stable merge
+ * of two sorted runs come from the left run: the fewest
+ * that leave no left element behind a right element it
+ * does not sort after. O(log k)
+ ************************************************/
+template <typename T, typename Compare, typename Allocator, bool isCounted>
+template <typename RandomIt, typename Less>
+size_t BST <T, Compare, Allocator, isCounted> :: coRank(RandomIt itLeft, size_t numLeft, RandomIt itRight, size_t numRight,
+                                                        size_t k, Less less)
+{
+    size_t lo = k > numRight ? k - numRight : 0;
+    size_t hi = std::min(k, numLeft);
+    while (lo < hi)
+    {
+        size_t i = lo + (hi - lo) / 2;
+        if (!less(itRight[k - i - 1], itLeft[i]))
+            lo = i + 1;     // left[i] comes before right[k - i - 1]: take more from the left
+        else
+            hi = i;
+    }
+    return lo;
+}
+
+/*************************************************
+ * BST :: COPY NODES
+ * num new detached nodes, node i holding a copy of
+ * source(i). The work is shared out between threads,
+ * each allocating the nodes for its own block (see
+ * AllocLock). On failure nothing is left behind
+ ************************************************/
+template <typename T, typename Compare, typename Allocator, bool isCounted>
+template <typename Source>
+void BST <T, Compare, Allocator, isCounted> :: copyNodes(std::vector<BNode *> & nodes, size_t num, Source source, unsigned numThreads,
+                                                         std::mutex & lockAlloc)
+{
+    // a block that fails cleans up after itself
+    nodes.assign(num, nullptr);
+    std::vector<char> isBuilt(num, false);
+    try
+    {
+        parallelFor(num, numThreads, [&](size_t begin, size_t end)
+        {
+            size_t i = begin;
+            {
+                AllocLock lock(lockAlloc);
+                try
+                {
+                    for (; i < end; i++)
+                        nodes[i] = NodeTraits::allocate(nodeAlloc(), 1);
+                }
+                catch (...)
+                {
+                    while (i-- > begin)
+                        NodeTraits::deallocate(nodeAlloc(), nodes[i], 1);
+                    throw;
+                }
+            }
+
+            try
+            {
+                for (i = begin; i < end; i++)
+                    NodeTraits::construct(nodeAlloc(), nodes[i], source(i));
+            }
+            catch (...)
+            {
+                while (i-- > begin)
+                    NodeTraits::destroy(nodeAlloc(), nodes[i]);
+                AllocLock lock(lockAlloc);
+                for (i = begin; i < end; i++)
+                    NodeTraits::deallocate(nodeAlloc(), nodes[i], 1);
+                throw;
+            }
+            std::fill(isBuilt.begin() + begin, isBuilt.begin() + end, true);
+        });
+    }
+    catch (...)
+    {
+        for (size_t i = 0; i < num; i++)
+            if (isBuilt[i])
+                deleteNode(nodes[i], lockAlloc);
+        nodes.clear();
+        throw;
+    }
+}
+
+/*************************************************
+ * BST :: LINK BALANCED
+ * BUILD BALANCED for nodes that already exist, given
+ * in order. The two halves are disjoint, so while
+ * there are threads to spare the left half is linked
+ * on another one
+ ************************************************/
+template <typename T, typename Compare, typename Allocator, bool isCounted>
+typename BST <T, Compare, Allocator, isCounted> :: BNode * BST <T, Compare, Allocator, isCounted> :: linkBalanced(BNode * const * pNodes, size_t num, size_t depth,
+                                                                                                                     size_t depthRed, unsigned numThreads)
+{
+    if (num == 0)
+        return nullptr;
+
+    size_t numLeft = (num - 1) / 2;
+    BNode* pNode = pNodes[numLeft];
+    BNode* pLeft;
+    BNode* pRight;
+    if (numThreads > 1 && num >= MIN_PARALLEL)
+    {
+        WorkerPool::Group halves;
+        halves.run([&]() { pLeft = linkBalanced(pNodes, numLeft, depth + 1, depthRed, numThreads / 2); });
+        pRight = linkBalanced(pNodes + numLeft + 1, num - 1 - numLeft, depth + 1, depthRed, numThreads - numThreads / 2);
+        halves.wait();
+    }
+    else
+    {
+        pLeft  = linkBalanced(pNodes, numLeft, depth + 1, depthRed, 1);
+        pRight = linkBalanced(pNodes + numLeft + 1, num - 1 - numLeft, depth + 1, depthRed, 1);
+    }
+
+    pNode->pParent = nullptr;
+    pNode->addLeft(pLeft);
+    pNode->addRight(pRight);
+    pNode->isRed = depth != 0 && depth == depthRed;
+    pNode->setCount(num);
+    return pNode;
+}
+
+/*************************************************
+ * BST :: SPLIT
+ * Keep everything less than key and return the rest
+ * as a new tree. The tree is cut along the search path
+ * for key and the pieces are joined back up on either
+ * side in O(log n). Each half also needs its size, which
+ * only an order-statistics tree (isCounted) can read off
+ * the new root; any other tree would have to count one
+ * half, so it does not offer split. The new tree shares
+ * our allocator, so the nodes move over as they are
+ ************************************************/
+template <typename T, typename Compare, typename Allocator, bool isCounted>
+BST <T, Compare, Allocator, isCounted> BST <T, Compare, Allocator, isCounted> :: split(const T & key)
+{
+    static_assert(isCounted, "split() needs a BST with isCounted set");
+    BST rhs(key_comp(), get_allocator());
+    if (root == nullptr)
+        return rhs;
+
+    BNode* pLeft;
+    BNode* pRight;
+    size_t heightLeft;
+    size_t heightRight;
+    splitNode(root, blackHeight(root), [this, &key](const BNode * p) { return this->isLess(p->data, key); },
+              pLeft, heightLeft, pRight, heightRight);
+
+    // how many went each way
+    size_t numLeft = BNode::countOf(pLeft);
+
+    rhs.root = pRight;
+    rhs.findEnds();
+    rhs.numElements = numElements - numLeft;
+    root = pLeft;
+    findEnds();
+    numElements = numLeft;
+    return rhs;
+}
+
+/*************************************************
+ * BST :: SPLIT NODE
+ * Cut the subtree under pNode (black, of the given
+ * black height) into the part before the cut and the
+ * rest, each with a black root, and their heights.
+ * isBefore(p) says which side of the cut p is on; it is
+ * asked once per level, top down, along the path to
+ * the cut. pNode's children are cut loose, one side is
+ * split further down, and pNode joins the pieces back up
+ ************************************************/
+template <typename T, typename Compare, typename Allocator, bool isCounted>
+template <typename Before>
+void BST <T, Compare, Allocator, isCounted> :: splitNode(BNode * pNode, size_t height, Before isBefore,
+                                                         BNode * & pLeft, size_t & heightLeft,
+                                                         BNode * & pRight, size_t & heightRight)
+{
+    if (pNode == nullptr)
+    {
+        pLeft = pRight = nullptr;
+        heightLeft = heightRight = 0;
+        return;
+    }
+
+    // each child becomes a tree of its own, with a black root
+    BNode* pChildren[2] = { pNode->pLeft, pNode->pRight };
+    size_t heights[2] = { height - 1, height - 1 };
+    for (int i = 0; i < 2; i++)
+        if (pChildren[i])
+        {
+            pChildren[i]->pParent = nullptr;
+            if (pChildren[i]->isRed)
+            {
+                pChildren[i]->isRed = false;
+                heights[i]++;
+            }
+        }
+
+    if (isBefore(pNode))
+    {
+        // pNode and its left subtree all go left
+        BNode* pMiddle;
+        size_t heightMiddle;
+        splitNode(pChildren[1], heights[1], isBefore, pMiddle, heightMiddle, pRight, heightRight);
+        pLeft = join(pChildren[0], heights[0], pNode, pMiddle, heightMiddle, heightLeft);
+    }
+    else
+    {
+        // pNode and its right subtree all go right
+        BNode* pMiddle;
+        size_t heightMiddle;
+        splitNode(pChildren[0], heights[0], isBefore, pLeft, heightLeft, pMiddle, heightMiddle);
+        pRight = join(pMiddle, heightMiddle, pNode, pChildren[1], heights[1], heightRight);
+    }
+}
+
+/*************************************************
+ * BST :: SPLIT AT
+ * SPLIT NODE by position rather than by key: pTarget
+ * (somewhere under pNode) and everything after it go
+ * right. A node on the path down to pTarget comes
+ * before it exactly when the path turns right there,
+ * so we note the turns on the way up first. Equal keys
+ * on either side of pTarget stay where they are
+ ************************************************/
+template <typename T, typename Compare, typename Allocator, bool isCounted>
+void BST <T, Compare, Allocator, isCounted> :: splitAt(BNode * pNode, size_t height, BNode * pTarget,
+                                                       BNode * & pLeft, size_t & heightLeft,
+                                                       BNode * & pRight, size_t & heightRight)
+{
+    std::vector<char> isRightTurn;
+    for (BNode* p = pTarget; p->pParent; p = p->pParent)
+        isRightTurn.push_back(p->isRightChild());
+
+    // asked from the top down, so the turns come off the back. Past
+    // pTarget we are in its left subtree, all of which comes before
+    auto isBefore = [&isRightTurn, pTarget](const BNode * p)
+    {
+        if (isRightTurn.empty())
+            return p != pTarget;
+        bool isRight = isRightTurn.back() != 0;
+        isRightTurn.pop_back();
+        return isRight;
+    };
+    splitNode(pNode, height, isBefore, pLeft, heightLeft, pRight, heightRight);
+}
+
+/*************************************************
+ * BST :: EXTRACT
+ * Take a node out of the tree and hand it over,
+ * value and all. Extracting end() gives an empty handle
+ ************************************************/
+template <typename T, typename Compare, typename Allocator, bool isCounted>
+typename BST <T, Compare, Allocator, isCounted> :: node_type BST <T, Compare, Allocator, isCounted> :: extract(iterator it)
+{
+    if (it == end())
+        return node_type();
+
+    unlink(it.pNode);
+    return node_type(it.pNode, nodeAlloc());
+}
+
+/*************************************************
+ * BST :: INSERT a NODE HANDLE
+ * Link an extracted node back in. Nothing is allocated
+ * or copied. If keepUnique turns it away, the node goes
+ * back to the caller in the result. A node from another
+ * pool has its value moved into one of ours, as in merge()
+ ************************************************/
+template <typename T, typename Compare, typename Allocator, bool isCounted>
+typename BST <T, Compare, Allocator, isCounted> :: insert_return_type BST <T, Compare, Allocator, isCounted> :: insert(node_type && nh, bool keepUnique)
+{
+    insert_return_type result;
+    result.position = end();
+    result.inserted = false;
+    if (nh.empty())
+        return result;
+
+    BNode* pParent;
+    bool isLeft;
+    BNode* pMatch = findParent(nh.pNode->data, keepUnique, pParent, isLeft);
+    if (pMatch)
+    {
+        result.position = iterator(pMatch, this);
+        result.node = std::move(nh);
+        return result;
+    }
+
+    BNode* pNew;
+    if (nh.alloc == nodeAlloc())
+    {
+        pNew = nh.release();
+        pNew->pLeft = pNew->pRight = pNew->pParent = nullptr;
+        pNew->isRed = true;
+        pNew->setCount(1);
+    }
+    else
+    {
+        pNew = newNode(std::move(nh.pNode->data));
+        nh.reset();
+    }
+    link(pNew, pParent, isLeft);
+
+    result.position = iterator(pNew, this);
+    result.inserted = true;
+    return result;
+}
+
+/*************************************************
+ * BST :: BLACK HEIGHT
+ * Black nodes on the way from pNode down to a leaf,
+ * pNode included. Every path has the same number
+ ************************************************/
+template <typename T, typename Compare, typename Allocator, bool isCounted>
+size_t BST <T, Compare, Allocator, isCounted> :: blackHeight(const BNode * pNode)
+{
+    size_t height = 0;
+    for (; pNode; pNode = pNode->pLeft)
+        if (!pNode->isRed)
+            height++;
+    return height;
+}
+
+/*************************************************
+ * BST :: JOIN
+ * Make one tree out of pLeft, pMid and pRight, where
+ * nothing in pLeft sorts after pMid and nothing in
+ * pRight sorts before it. Both sides must have black
+ * roots (or be empty) of the given black heights. pMid
+ * goes down the spine of the taller side to where the
+ * shorter side fits, as a red node, and insert fixup
+ * does the rest. O(difference in heights). Returns the
+ * root of the result, with its black height in heightResult
+ ************************************************/
+template <typename T, typename Compare, typename Allocator, bool isCounted>
+typename BST <T, Compare, Allocator, isCounted> :: BNode * BST <T, Compare, Allocator, isCounted> :: join(BNode * pLeft, size_t heightLeft, BNode * pMid,
+                                                                                                          BNode * pRight, size_t heightRight, size_t & heightResult)
+{
+    pMid->pParent = nullptr;
+
+    // the same height: pMid goes on top
+    if (heightLeft == heightRight)
+    {
+        pMid->addLeft(pLeft);
+        pMid->addRight(pRight);
+        pMid->isRed = false;
+        pMid->recount();
+        heightResult = heightLeft + 1;
+        return pMid;
+    }
+
+    // find the black node (or empty leaf) on the taller tree's inside
+    // spine that is exactly as tall as the shorter tree
+    bool isLeftTaller = heightLeft > heightRight;
+    BNode* pTall = isLeftTaller ? pLeft : pRight;
+    size_t height = isLeftTaller ? heightLeft : heightRight;
+    size_t heightShort = isLeftTaller ? heightRight : heightLeft;
+    BNode* pParent = nullptr;
+    BNode* p = pTall;
+    while (p && (p->isRed || height != heightShort))
+    {
+        if (!p->isRed)
+            height--;
+        pParent = p;
+        p = isLeftTaller ? p->pRight : p->pLeft;
+    }
+
+    // pMid takes its place with the shorter tree beside it
+    pMid->isRed = true;
+    if (isLeftTaller)
+    {
+        pMid->addLeft(p);
+        pMid->addRight(pRight);
+        pParent->addRight(pMid);
+    }
+    else
+    {
+        pMid->addLeft(pLeft);
+        pMid->addRight(p);
+        pParent->addLeft(pMid);
+    }
+    if (isCounted)
+        for (BNode* pUp = pMid; pUp; pUp = pUp->pParent)
+            pUp->recount();
+
+    BNode* pRoot = pTall;
+    heightResult = (isLeftTaller ? heightLeft : heightRight) + (insertFixup(pRoot, pMid) ? 1 : 0);
+    return pRoot;
+}
+
+/*************************************************
+ * BST :: REPLACE
+ * Put pNew in the spot pOld holds under its parent
+ * (or at pRoot, the top of the tree pOld is in). pOld's
+ * own children are untouched
+ ************************************************/
+template <typename T, typename Compare, typename Allocator, bool isCounted>
+void BST <T, Compare, Allocator, isCounted> :: replace(BNode * & pRoot, BNode * pOld, BNode * pNew)
+{
+    if (pOld->pParent == nullptr)
+        pRoot = pNew;
+    else if (pOld->isLeftChild())
+        pOld->pParent->pLeft = pNew;
+    else
+        pOld->pParent->pRight = pNew;
+
+    if (pNew)
+        pNew->pParent = pOld->pParent;
+}
+
+/*************************************************
+ * BST :: ROTATE LEFT
+ * pNode's right child takes its place and pNode
+ * becomes that child's left child
+ *         (p)                 (r)
+ *       +--+--+             +--+--+
+ *      a     (r)    =>     (p)    c
+ *          +--+--+       +--+--+
+ *          b     c       a     b
+ ************************************************/
+template <typename T, typename Compare, typename Allocator, bool isCounted>
+void BST <T, Compare, Allocator, isCounted> :: rotateLeft(BNode * & pRoot, BNode * pNode)
+{
+    BNode* pPivot = pNode->pRight;
+    pNode->addRight(pPivot->pLeft);
+    replace(pRoot, pNode, pPivot);
+    pPivot->addLeft(pNode);
+    pPivot->setCount(pNode->getCount());
+    pNode->recount();
+}
+
+/*************************************************
+ * BST :: ROTATE RIGHT
+ * pNode's left child takes its place and pNode
+ * becomes that child's right child
+ ************************************************/
+template <typename T, typename Compare, typename Allocator, bool isCounted>
+void BST <T, Compare, Allocator, isCounted> :: rotateRight(BNode * & pRoot, BNode * pNode)
+{
+    BNode* pPivot = pNode->pLeft;
+    pNode->addLeft(pPivot->pRight);
+    replace(pRoot, pNode, pPivot);
+    pPivot->addRight(pNode);
+    pPivot->setCount(pNode->getCount());
+    pNode->recount();
+}
+
+/*************************************************
+ * BST :: INSERT FIXUP
+ * A new red node was just linked in. Recolor and
+ * rotate until no red node has a red parent. Returns
+ * true if pRoot had to be painted black, which
+ * makes the whole tree one black level taller
+ ************************************************/
+template <typename T, typename Compare, typename Allocator, bool isCounted>
+bool BST <T, Compare, Allocator, isCounted> :: insertFixup(BNode * & pRoot, BNode * pNode)
+{
+    while (pNode->pParent && pNode->pParent->isRed)
+    {
+        BNode* pParent = pNode->pParent;
+        BNode* pGranny = pParent->pParent;
+
+        // a red root: painting it black below is all we need
+        if (pGranny == nullptr)
+            break;
+
+        if (pParent == pGranny->pLeft)
+        {
+            BNode* pAunt = pGranny->pRight;
+
+            // red aunt: push the blackness down from granny and go up
+            if (pAunt && pAunt->isRed)
+            {
+                pParent->isRed = false;
+                pAunt->isRed = false;
+                pGranny->isRed = true;
+                pNode = pGranny;
+                continue;
+            }
+
+            // black aunt: at most two rotations and we are done
+            if (pNode == pParent->pRight)
+            {
+                rotateLeft(pRoot, pParent);
+                pParent = pNode;
+            }
+            pParent->isRed = false;
+            pGranny->isRed = true;
+            rotateRight(pRoot, pGranny);
+        }
+        else
+        {
+            BNode* pAunt = pGranny->pLeft;
+
+            if (pAunt && pAunt->isRed)
+            {
+                pParent->isRed = false;
+                pAunt->isRed = false;
+                pGranny->isRed = true;
+                pNode = pGranny;
+                continue;
+            }
+
+            if (pNode == pParent->pLeft)
+            {
+                rotateRight(pRoot, pParent);
+                pParent = pNode;
+            }
+            pParent->isRed = false;
+            pGranny->isRed = true;
+            rotateLeft(pRoot, pGranny);
+        }
+        break;
+    }
+    bool isTaller = pRoot->isRed;
+    pRoot->isRed = false;
+    return isTaller;
+}
+
+/*************************************************
+ * BST :: ERASE FIXUP
+ * A black node was removed from above pNode, so every
+ * path through pNode is one black short. pNode may be
+ * nullptr which is why we are also given its parent
+ ************************************************/
+template <typename T, typename Compare, typename Allocator, bool isCounted>
+void BST <T, Compare, Allocator, isCounted> :: eraseFixup(BNode * pNode, BNode * pParent)
+{
+    while (pNode != root && (pNode == nullptr || !pNode->isRed))
+    {
+        if (pNode == pParent->pLeft)
+        {
+            BNode* pSibling = pParent->pRight;
+
+            // red sibling: rotate so the sibling is black
+            if (pSibling->isRed)
+            {
+                pSibling->isRed = false;
+                pParent->isRed = true;
+                rotateLeft(root, pParent);
+                pSibling = pParent->pRight;
+            }
+
+            // both nephews black: take one black from the sibling and go up
+            if (BNode::isBlack(pSibling->pLeft) && BNode::isBlack(pSibling->pRight))
+            {
+                pSibling->isRed = true;
+                pNode = pParent;
+                pParent = pNode->pParent;
+                continue;
+            }
+
+            // far nephew red: one rotation at the parent settles it
+            if (BNode::isBlack(pSibling->pRight))
+            {
+                pSibling->pLeft->isRed = false;
+                pSibling->isRed = true;
+                rotateRight(root, pSibling);
+                pSibling = pParent->pRight;
+            }
+            pSibling->isRed = pParent->isRed;
+            pParent->isRed = false;
+            pSibling->pRight->isRed = false;
+            rotateLeft(root, pParent);
+        }
+        else
+        {
+            BNode* pSibling = pParent->pLeft;
+
+            if (pSibling->isRed)
+            {
+                pSibling->isRed = false;
+                pParent->isRed = true;
+                rotateRight(root, pParent);
+                pSibling = pParent->pLeft;
+            }
+
+            if (BNode::isBlack(pSibling->pLeft) && BNode::isBlack(pSibling->pRight))
+            {
+                pSibling->isRed = true;
+                pNode = pParent;
+                pParent = pNode->pParent;
+                continue;
+            }
+
+            if (BNode::isBlack(pSibling->pLeft))
+            {
+                pSibling->pRight->isRed = false;
+                pSibling->isRed = true;
+                rotateLeft(root, pSibling);
+                pSibling = pParent->pLeft;
+            }
+            pSibling->isRed = pParent->isRed;
+            pParent->isRed = false;
+            pSibling->pLeft->isRed = false;
+            rotateRight(root, pParent);
+        }
+        pNode = root;
+    }
+
+    if (pNode)
+        pNode->isRed = false;
+}
+
+
+/*****************************************************
+ * BST :: CLEAR
+ * Removes all the BNodes from a tree
+ ****************************************************/
+template <typename T, typename Compare, typename Allocator, bool isCounted>
+void BST <T, Compare, Allocator, isCounted> ::clear() noexcept
+{
+    releaseNodes(CanRelease<NodeAllocator>());
+    root = pFirst = pLast = nullptr;
+    numElements = 0;
+}
+
+/*****************************************************
+ * BST :: RELEASE NODES
+ * When the allocator can free everything at once, only
+ * visit the nodes to run T's destructor (if it has one)
+ * and then drop the memory in one go. Otherwise, or while
+ * another tree or a node handle shares the pool, hand
+ * each node back individually
+ ****************************************************/
+template <typename T, typename Compare, typename Allocator, bool isCounted>
+void BST <T, Compare, Allocator, isCounted> ::releaseNodes(std::true_type)
+{
+    if (!nodeAlloc().canRelease())
+    {
+        clear(root);
+        return;
+    }
+    if (!std::is_trivially_destructible<T>::value)
+        destroyValues(root);
+    nodeAlloc().release();
+}
+
+template <typename T, typename Compare, typename Allocator, bool isCounted>
+void BST <T, Compare, Allocator, isCounted> ::releaseNodes(std::false_type)
+{
+    clear(root);
+}
+
+/*****************************************************
+ * BST :: DESTROY VALUES
+ * Run the destructor on every node without freeing them.
+ * Same walk as CLEAR below
+ ****************************************************/
+template <typename T, typename Compare, typename Allocator, bool isCounted>
+void BST <T, Compare, Allocator, isCounted> ::destroyValues(BNode* pThis)
+{
+    while (pThis)
+    {
+        if (pThis->pLeft)
+        {
+            BNode* pLeft = pThis->pLeft;
+            pThis->pLeft = pLeft->pRight;
+            pLeft->pRight = pThis;
+            pThis = pLeft;
+        }
+        else
+        {
+            BNode* pRight = pThis->pRight;
+            NodeTraits::destroy(nodeAlloc(), pThis);
+            pThis = pRight;
+        }
+    }
+}
+
+/*****************************************************
+ * BST :: CLEAR
+ * Removes all the BNodes below pThis, including pThis.
+ * No recursion and no stack: whenever the current node
+ * has a left child we rotate right so that child comes
+ * up, and once there is no left child the node can go.
+ * Every rotation puts one node on the right spine for
+ * good, so this is linear and never runs out of stack
+ ****************************************************/
+template <typename T, typename Compare, typename Allocator, bool isCounted>
+void BST <T, Compare, Allocator, isCounted> ::clear(BNode*& pThis)
+{
+    BNode* p = pThis;
+    while (p)
+    {
+        if (p->pLeft)
+        {
+            BNode* pLeft = p->pLeft;
+            p->pLeft = pLeft->pRight;
+            pLeft->pRight = p;
+            p = pLeft;
+        }
+        else
+        {
+            BNode* pRight = p->pRight;
+            deleteNode(p);
+            p = pRight;
+        }
+    }
+    pThis = nullptr;
+}
+
+/*****************************************************
+ * BST :: NEW NODE
+ * Allocate a node from the tree's allocator and build it
+ * in place. If the constructor throws, give the memory back
+ ****************************************************/
+template <typename T, typename Compare, typename Allocator, bool isCounted>
+template <typename ... Args>
+typename BST <T, Compare, Allocator, isCounted> :: BNode * BST <T, Compare, Allocator, isCounted> :: newNode(Args && ... args)
+{
+    BNode* pNode = NodeTraits::allocate(nodeAlloc(), 1);
+    try
+    {
+        NodeTraits::construct(nodeAlloc(), pNode, std::forward<Args>(args)...);
+    }
+    catch (...)
+    {
+        NodeTraits::deallocate(nodeAlloc(), pNode, 1);
+        throw;
+    }
+    return pNode;
+}
+
+/*****************************************************
+ * BST :: DELETE NODE
+ * Destroy a node and hand its memory back to the allocator
+ ****************************************************/
+template <typename T, typename Compare, typename Allocator, bool isCounted>
+void BST <T, Compare, Allocator, isCounted> :: deleteNode(BNode * pNode)
+{
+    NodeTraits::destroy(nodeAlloc(), pNode);
+    NodeTraits::deallocate(nodeAlloc(), pNode, 1);
+}
+
+/*****************************************************
+ * BST :: DELETE NODE - shared
+ * The same, from one of several threads (see AllocLock)
+ ****************************************************/
+template <typename T, typename Compare, typename Allocator, bool isCounted>
+void BST <T, Compare, Allocator, isCounted> :: deleteNode(BNode * pNode, std::mutex & lockAlloc)
+{
+    NodeTraits::destroy(nodeAlloc(), pNode);
+    AllocLock lock(lockAlloc);
+    NodeTraits::deallocate(nodeAlloc(), pNode, 1);
+}
+
+/****************************************************
+ * BST :: FIND NODE
+ * Return the node corresponding to a given key. Only the
+ * comparator is used: one comparison per level to find the
+ * first node not less than k, then one more to see if it is k
+ ****************************************************/
+template <typename T, typename Compare, typename Allocator, bool isCounted>
+template <typename K>
+typename BST <T, Compare, Allocator, isCounted> :: BNode * BST <T, Compare, Allocator, isCounted> :: findNode(const K & k) const
+{
+    BNode* pCandidate = lowerBound(k);
+    if (pCandidate && !this->isLess(k, pCandidate->data))
+        return pCandidate;
+    return nullptr;
+}
 
 /****************************************************
- * BST :: REMOVENODE (Created by Steve)
- * Remove the specified node
+ * BST :: FIND BATCH
+ * find() every key in [first, last), writing one
+ * iterator per key to out. A lone descent waits on
+ * every load along its path. Here FIND_BATCH descents
+ * take one step each in turn, and each prefetches the
+ * node it will visit next, so by the time we come back
+ * to it that node is likely in the cache. Same walk
+ * and comparisons as FIND NODE
+ ****************************************************/
+template <typename T, typename Compare, typename Allocator, bool isCounted>
+template <typename ForwardIt, typename OutputIt>
+OutputIt BST <T, Compare, Allocator, isCounted> :: find_batch(ForwardIt first, ForwardIt last, OutputIt out) const
+{
+    ForwardIt itKeys[FIND_BATCH];
+    BNode* pCursors[FIND_BATCH];
+    BNode* pCandidates[FIND_BATCH];
+
+    while (first != last)
+    {
+        size_t num = 0;
+        for (; num < FIND_BATCH && first != last; ++first, ++num)
+        {
+            itKeys[num] = first;
+            pCursors[num] = root;
+            pCandidates[num] = nullptr;
+        }
+
+        // one level per pass until every descent falls off the tree
+        for (size_t numActive = num; numActive; )
+        {
+            numActive = 0;
+            for (size_t i = 0; i < num; i++)
+            {
+                BNode* p = pCursors[i];
+                if (p == nullptr)
+                    continue;
+                if (this->isLess(p->data, *itKeys[i]))
+                    p = p->pRight;
+                else
+                {
+                    pCandidates[i] = p;
+                    p = p->pLeft;
+                }
+                if (p)
+                {
+                    BST_PREFETCH(p);
+                    numActive++;
+                }
+                pCursors[i] = p;
+            }
+        }
+
+        for (size_t i = 0; i < num; i++)
+        {
+            BNode* pFound = pCandidates[i];
+            if (pFound && this->isLess(*itKeys[i], pFound->data))
+                pFound = nullptr;
+            *out++ = iterator(pFound, this);
+        }
+    }
+    return out;
+}
+
+/*****************************************************
+ * BST :: COUNT KEY
+ * How many elements are equivalent to k
+ ****************************************************/
+template <typename T, typename Compare, typename Allocator, bool isCounted>
+template <typename K>
+size_t BST <T, Compare, Allocator, isCounted> :: countKey(const K & k) const
+{
+    size_t num = 0;
+    for (BNode* p = lowerBound(k), * pEnd = upperBound(k); p != pEnd; p = BNode::next(p))
+        num++;
+    return num;
+}
+
+/*****************************************************
+ * BST :: ERASE KEY
+ * Remove every element equivalent to k and say how many
+ * there were. Erasing relinks nodes rather than moving
+ * values, so the upper bound stays put while we go
+ ****************************************************/
+template <typename T, typename Compare, typename Allocator, bool isCounted>
+template <typename K>
+size_t BST <T, Compare, Allocator, isCounted> :: eraseKey(const K & k)
+{
+    size_t num = 0;
+    iterator itEnd(upperBound(k));
+    for (iterator it(lowerBound(k)); it != itEnd; num++)
+        it = erase(it);
+    return num;
+}
+
+/*****************************************************
+ * BST :: ADVANCE
+ * The iterator k places after it (before it when k is
+ * negative), found by rank rather than by stepping.
+ * Walking off either end gives end()
+ ****************************************************/
+template <typename T, typename Compare, typename Allocator, bool isCounted>
+typename BST <T, Compare, Allocator, isCounted> :: iterator BST <T, Compare, Allocator, isCounted> :: advance(iterator it, std::ptrdiff_t k) const
+{
+    static_assert(isCounted, "advance() needs a BST with isCounted set");
+    std::ptrdiff_t pos = (it.pNode ? rankNode(it.pNode) : numElements) + k;
+    if (pos < 0)
+        return end();
+    return select(pos);
+}
+
+/*****************************************************
+ * BST :: SELECT NODE
+ * The k-th smallest node counting from 0, or nullptr.
+ * The left subtree's size says which way to go
+ ****************************************************/
+template <typename T, typename Compare, typename Allocator, bool isCounted>
+typename BST <T, Compare, Allocator, isCounted> :: BNode * BST <T, Compare, Allocator, isCounted> :: selectNode(size_t k) const
+{
+    static_assert(isCounted, "select() needs a BST with isCounted set");
+    BNode* p = root;
+    while (p)
+    {
+        size_t numLeft = BNode::countOf(p->pLeft);
+        if (k < numLeft)
+            p = p->pLeft;
+        else if (k == numLeft)
+            return p;
+        else
+        {
+            k -= numLeft + 1;
+            p = p->pRight;
+        }
+    }
+    return nullptr;
+}
+
+/*****************************************************
+ * BST :: RANK NODE
+ * How many nodes come before pNode: its left subtree
+ * plus everything left of each ancestor we are right of
+ ****************************************************/
+template <typename T, typename Compare, typename Allocator, bool isCounted>
+size_t BST <T, Compare, Allocator, isCounted> :: rankNode(const BNode * pNode) const
+{
+    size_t rank = BNode::countOf(pNode->pLeft);
+    for (; pNode->pParent; pNode = pNode->pParent)
+        if (pNode->isRightChild())
+            rank += BNode::countOf(pNode->pParent->pLeft) + 1;
+    return rank;
+}
+
+/*****************************************************
+ * BST :: RANK KEY
+ * How many elements are less than k. Same walk as
+ * LOWER BOUND, adding up whatever we pass on the left
  ****************************************************/
-template<typename T>
-inline void BST<T>::removeNode(BNode* pNode)
+template <typename T, typename Compare, typename Allocator, bool isCounted>
+template <typename K>
+size_t BST <T, Compare, Allocator, isCounted> :: rankKey(const K & k) const
 {
-    if (pNode) {
-        if (pNode->pLeft)
-        {
-            removeNode(pNode->pLeft);
-            delete pNode->pLeft;
-        }
-        if (pNode->pRight)
+    static_assert(isCounted, "rank() needs a BST with isCounted set");
+    size_t rank = 0;
+    BNode* p = root;
+    while (p)
+    {
+        if (this->isLess(p->data, k))
         {
-            removeNode(pNode->pRight);
-            delete pNode->pRight;
+            rank += BNode::countOf(p->pLeft) + 1;
+            p = p->pRight;
         }
+        else
+            p = p->pLeft;
     }
-    delete pNode;
+    return rank;
 }
 
 /*****************************************************
- * BST :: BEGIN
- * Return the first node (left-most) in a binary search tree
+ * BST :: LOWER BOUND
+ * The first node not less than k, or nullptr. One
+ * comparison per level: whenever we go left, the node
+ * we leave is the best candidate so far
  ****************************************************/
-template <typename T>
-typename BST <T> :: iterator custom :: BST <T> :: begin() const noexcept
+template <typename T, typename Compare, typename Allocator, bool isCounted>
+template <typename K>
+typename BST <T, Compare, Allocator, isCounted> :: BNode * BST <T, Compare, Allocator, isCounted> :: lowerBound(const K & k) const
 {
-    if (root == nullptr)
-        return nullptr;
-
-    BNode* leftdata = root;
-    while (leftdata->pLeft)
-        leftdata = leftdata->pLeft;
-
-    return iterator(leftdata);
-} 
+    BNode* pCandidate = nullptr;
+    BNode* p = root;
+    while (p)
+    {
+        if (this->isLess(p->data, k))
+            p = p->pRight;
+        else
+        {
+            pCandidate = p;
+            p = p->pLeft;
+        }
+    }
+    return pCandidate;
+}
 
-/****************************************************
- * BST :: FIND
- * Return the node corresponding to a given value
+/*****************************************************
+ * BST :: UPPER BOUND
+ * The first node greater than k, or nullptr
  ****************************************************/
-template <typename T>
-typename BST <T> :: iterator BST<T> :: find(const T & t)
+template <typename T, typename Compare, typename Allocator, bool isCounted>
+template <typename K>
+typename BST <T, Compare, Allocator, isCounted> :: BNode * BST <T, Compare, Allocator, isCounted> :: upperBound(const K & k) const
 {
+    BNode* pCandidate = nullptr;
     BNode* p = root;
     while (p)
     {
-        if (p->data == t)
-            return iterator(p);
-        else if (p->data < t)
-            p = p->pRight;
-        else
+        if (this->isLess(k, p->data))
+        {
+            pCandidate = p;
             p = p->pLeft;
+        }
+        else
+            p = p->pRight;
     }
-   return iterator(p);
+    return pCandidate;
 }
 
 /******************************************************
@@ -565,66 +3692,76 @@ typename BST <T> :: iterator BST<T> :: find(const T & t)
  * BINARY NODE :: ADD LEFT
  * Add a node to the left of the current node
  ******************************************************/
-template <typename T>
-void BST <T> :: BNode :: addLeft (BNode * pNode)
+template <typename T, bool isCounted>
+void BSTNode <T, isCounted> :: addLeft (BSTNode * pNode)
 {
-    // does not increase % 
     if (pNode)
-        pParent = pNode->pParent;
-    pLeft = pNode->pLeft;
+        pNode->pParent = this;
+    pLeft = pNode;
 }
 
 /******************************************************
  * BINARY NODE :: ADD RIGHT
  * Add a node to the right of the current node
  ******************************************************/
-template <typename T>
-void BST <T> :: BNode :: addRight (BNode * pNode)
+template <typename T, bool isCounted>
+void BSTNode <T, isCounted> :: addRight (BSTNode * pNode)
 {
-    // does not increase % 
     if (pNode)
-        pParent = pNode->pParent;
-    pRight = pNode->pRight;
+        pNode->pParent = this;
+    pRight = pNode;
 }
 
 /******************************************************
- * BINARY NODE :: ADD LEFT
- * Add a node to the left of the current node
+ * BINARY NODE :: FIRST and LAST
+ * The left-most and right-most nodes at or below pNode
  ******************************************************/
-template <typename T>
-void BST<T> :: BNode :: addLeft (const T & t)
+template <typename T, bool isCounted>
+BSTNode <T, isCounted> * BSTNode <T, isCounted> :: first (BSTNode * pNode)
 {
-    pLeft = new BNode(t);
+    if (pNode)
+        while (pNode->pLeft)
+            pNode = pNode->pLeft;
+    return pNode;
 }
 
-/******************************************************
- * BINARY NODE :: ADD LEFT
- * Add a node to the left of the current node
- ******************************************************/
-template <typename T>
-void BST<T> ::BNode::addLeft(T && t)
+template <typename T, bool isCounted>
+BSTNode <T, isCounted> * BSTNode <T, isCounted> :: last (BSTNode * pNode)
 {
-    pLeft = new BNode(std::move(t));
+    if (pNode)
+        while (pNode->pRight)
+            pNode = pNode->pRight;
+    return pNode;
 }
 
 /******************************************************
- * BINARY NODE :: ADD RIGHT
- * Add a node to the right of the current node
+ * BINARY NODE :: NEXT
+ * The node after pNode in order: the left-most node of
+ * the right subtree, or else the first ancestor we reach
+ * from its left side
  ******************************************************/
-template <typename T>
-void BST <T> :: BNode :: addRight (const T & t)
+template <typename T, bool isCounted>
+BSTNode <T, isCounted> * BSTNode <T, isCounted> :: next (BSTNode * pNode)
 {
-    pRight = new BNode(t);
+    if (pNode->pRight)
+        return first(pNode->pRight);
+    while (pNode->isRightChild())
+        pNode = pNode->pParent;
+    return pNode->pParent;
 }
 
 /******************************************************
- * BINARY NODE :: ADD RIGHT
- * Add a node to the right of the current node
+ * BINARY NODE :: PREV
+ * The node before pNode in order. Mirror of NEXT
  ******************************************************/
-template <typename T>
-void BST <T> :: BNode :: addRight (T && t)
+template <typename T, bool isCounted>
+BSTNode <T, isCounted> * BSTNode <T, isCounted> :: prev (BSTNode * pNode)
 {
-    pRight = new BNode(std::move(t));
+    if (pNode->pLeft)
+        return last(pNode->pLeft);
+    while (pNode->isLeftChild())
+        pNode = pNode->pParent;
+    return pNode->pParent;
 }
 
 /*************************************************
@@ -639,8 +3776,8 @@ void BST <T> :: BNode :: addRight (T && t)
  * BST ITERATOR :: INCREMENT PREFIX
  * advance by one
  *************************************************/
-template <typename T>
-typename BST <T> :: iterator & BST <T> :: iterator :: operator ++ () 
+template <typename T, typename Compare, typename Allocator, bool isCounted>
+typename BST <T, Compare, Allocator, isCounted> :: iterator & BST <T, Compare, Allocator, isCounted> :: iterator :: operator ++ () 
 {
     if (pNode == nullptr)
         return *this;
@@ -674,11 +3811,16 @@ typename BST <T> :: iterator & BST <T> :: iterator :: operator ++ ()
  * BST ITERATOR :: DECREMENT PREFIX
  * advance by one
  *************************************************/
-template <typename T>
-typename BST <T> :: iterator & BST <T> :: iterator :: operator -- ()
+template <typename T, typename Compare, typename Allocator, bool isCounted>
+typename BST <T, Compare, Allocator, isCounted> :: iterator & BST <T, Compare, Allocator, isCounted> :: iterator :: operator -- ()
 {
+    // back from the end is the last node
     if (pNode == nullptr)
+    {
+        if (pTree)
+            pNode = pTree->lastNode();
         return *this;
+    }
 
     if (pNode->pLeft != nullptr)
     {
@@ -706,21 +3848,501 @@ typename BST <T> :: iterator & BST <T> :: iterator :: operator -- ()
 }
 
 
-/*****************************************************
- * DELETE BINARY TREE
- * Delete all the nodes below pThis including pThis
- * using postfix traverse: LRV
- ****************************************************/
-template <class T>
-void BST<T>::BNode::clear(BNode* pThis)
+/*************************************************
+ *************************************************
+ *****************              ******************
+ *****************  FROZEN BST  ******************
+ *****************              ******************
+ *************************************************
+ *************************************************/
+
+/*************************************************
+ * FROZEN BST :: CONSTRUCTOR
+ * Copy a sorted range into breadth-first order.
+ * Walking the slots in order tells us which element
+ * each slot gets; then each is copied exactly once,
+ * slot by slot
+ ************************************************/
+template <typename T, typename Compare>
+template <typename ForwardIt, typename>
+FrozenBST <T, Compare> :: FrozenBST(ForwardIt first, ForwardIt last, const Compare & comp) : KeyCompare<Compare>(comp)
+{
+    assert(std::is_sorted(first, last, comp));
+
+    std::vector<ForwardIt> order;
+    for (; first != last; ++first)
+        order.push_back(first);
+
+    size_t num = order.size();
+    std::vector<size_t> rank(num);
+    size_t i = 0;
+    for (size_t k = firstSlot(num); k; k = nextSlot(k, num))
+        rank[k - 1] = i++;
+
+    keys.reserve(num);
+    for (size_t k = 1; k <= num; k++)
+        keys.push_back(*order[rank[k - 1]]);
+}
+
+/*************************************************
+ * FROZEN BST :: FIND
+ * The first element not less than k, if it is k
+ ************************************************/
+template <typename T, typename Compare>
+typename FrozenBST <T, Compare> :: iterator FrozenBST <T, Compare> :: find(const T & t) const
+{
+    size_t k = lowerBound(t);
+    return iterator(k && !this->isLess(t, keys[k - 1]) ? k : 0, this);
+}
+
+template <typename T, typename Compare>
+template <typename K, typename C, typename>
+typename FrozenBST <T, Compare> :: iterator FrozenBST <T, Compare> :: find(const K & key) const
+{
+    size_t k = lowerBound(key);
+    return iterator(k && !this->isLess(key, keys[k - 1]) ? k : 0, this);
+}
+
+/*************************************************
+ * FROZEN BST :: LOWER BOUND
+ * The slot of the first element not less than key,
+ * or 0. Go down to the bottom with k = 2k + (less),
+ * which needs no branch. The answer is where we last
+ * went left: shifting off the trailing right turns
+ * (ones) and that left turn climbs back up to it
+ ************************************************/
+template <typename T, typename Compare>
+template <typename K>
+size_t FrozenBST <T, Compare> :: lowerBound(const K & key) const
+{
+    const T * pKeys = keys.data();
+    size_t num = keys.size();
+    size_t k = 1;
+    while (k <= num)
+    {
+        BST_PREFETCH(pKeys + std::min(k * prefetchAhead(), num) - 1);
+        k = 2 * k + (this->isLess(pKeys[k - 1], key) ? 1 : 0);
+    }
+    return k >> (trailingOnes(k) + 1);
+}
+
+/*************************************************
+ * FROZEN BST :: UPPER BOUND
+ * The slot of the first element greater than key,
+ * or 0. As LOWER BOUND, going right on equal too
+ ************************************************/
+template <typename T, typename Compare>
+template <typename K>
+size_t FrozenBST <T, Compare> :: upperBound(const K & key) const
+{
+    const T * pKeys = keys.data();
+    size_t num = keys.size();
+    size_t k = 1;
+    while (k <= num)
+    {
+        BST_PREFETCH(pKeys + std::min(k * prefetchAhead(), num) - 1);
+        k = 2 * k + (this->isLess(key, pKeys[k - 1]) ? 0 : 1);
+    }
+    return k >> (trailingOnes(k) + 1);
+}
+
+/*************************************************
+ * FROZEN BST :: TRAILING ONES
+ * How many low bits of k are set: the right turns
+ * at the end of the path to slot k
+ ************************************************/
+template <typename T, typename Compare>
+unsigned FrozenBST <T, Compare> :: trailingOnes(size_t k)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    return ~k ? static_cast<unsigned>(__builtin_ctzll(~static_cast<unsigned long long>(k))) : 64;
+#else
+    unsigned num = 0;
+    for (; k & 1; k >>= 1)
+        num++;
+    return num;
+#endif
+}
+
+/*************************************************
+ * FROZEN BST :: FIRST and LAST SLOT
+ * The left-most and right-most of num slots, or 0
+ ************************************************/
+template <typename T, typename Compare>
+size_t FrozenBST <T, Compare> :: firstSlot(size_t num)
+{
+    if (num == 0)
+        return 0;
+    size_t k = 1;
+    while (2 * k <= num)
+        k = 2 * k;
+    return k;
+}
+
+template <typename T, typename Compare>
+size_t FrozenBST <T, Compare> :: lastSlot(size_t num)
+{
+    if (num == 0)
+        return 0;
+    size_t k = 1;
+    while (2 * k + 1 <= num)
+        k = 2 * k + 1;
+    return k;
+}
+
+/*************************************************
+ * FROZEN BST :: NEXT SLOT
+ * The slot after k in order: the left-most slot of
+ * the right subtree, or else climb past every right
+ * turn and one left turn. 0 past the end
+ ************************************************/
+template <typename T, typename Compare>
+size_t FrozenBST <T, Compare> :: nextSlot(size_t k, size_t num)
+{
+    if (2 * k + 1 <= num)
+    {
+        k = 2 * k + 1;
+        while (2 * k <= num)
+            k = 2 * k;
+        return k;
+    }
+    return k >> (trailingOnes(k) + 1);
+}
+
+/*************************************************
+ * FROZEN BST :: PREV SLOT
+ * The slot before k in order. Mirror of NEXT SLOT
+ ************************************************/
+template <typename T, typename Compare>
+size_t FrozenBST <T, Compare> :: prevSlot(size_t k, size_t num)
+{
+    if (2 * k <= num)
+    {
+        k = 2 * k;
+        while (2 * k + 1 <= num)
+            k = 2 * k + 1;
+        return k;
+    }
+    return k >> (trailingOnes(~k) + 1);
+}
+
+/*************************************************
+ *************************************************
+ ***************                  ****************
+ ***************  POOL ALLOCATOR  ****************
+ ***************                  ****************
+ *************************************************
+ *************************************************/
+
+/*************************************************
+ * POOL ALLOCATOR :: ALLOCATE and DEALLOCATE
+ * Single nodes come from the pool; anything else
+ * goes straight to the heap
+ ************************************************/
+template <typename T>
+T * PoolAllocator <T> :: allocate(size_t n)
+{
+    if (n != 1)
+        return static_cast<T *>(::operator new(n * sizeof(T)));
+    return static_cast<T *>(pPool->allocate(sizeof(T), alignof(T)));
+}
+
+template <typename T>
+void PoolAllocator <T> :: deallocate(T * p, size_t n) noexcept
+{
+    if (n != 1)
+        ::operator delete(p);
+    else
+        pPool->deallocate(p, sizeof(T), alignof(T));
+}
+
+/*************************************************
+ * SLAB POOL :: BLOCK SIZE
+ * Room for the object or a free list link, whichever
+ * is bigger, rounded up so that every block in a slab
+ * is aligned. Objects too big or too aligned to share
+ * a slab get 0: they come from the heap one at a time
+ ************************************************/
+inline size_t SlabPool :: blockSize(size_t size, size_t align)
+{
+    if (align < alignof(Block))
+        align = alignof(Block);
+    if (size < sizeof(Block))
+        size = sizeof(Block);
+    size = (size + align - 1) / align * align;
+    if (align > alignof(std::max_align_t) || size > (SLAB_SIZE - slabHeader()) / 4)
+        return 0;
+    return size;
+}
+
+/*************************************************
+ * SLAB POOL :: FIND BUCKET
+ * The free list for one block size, made the first
+ * time that size is asked for. There are rarely more
+ * than two: the value type and the node type
+ ************************************************/
+inline SlabPool::Bucket * SlabPool :: findBucket(size_t size)
+{
+    Bucket* pBucket = pBuckets;
+    while (pBucket && pBucket->size != size)
+        pBucket = pBucket->pNextBucket;
+    if (pBucket == nullptr)
+    {
+        pBucket = new Bucket;
+        pBucket->size = size;
+        pBucket->pFree = nullptr;
+        pBucket->pNext = pBucket->pEnd = nullptr;
+        pBucket->pNextBucket = pBuckets;
+        pBuckets = pBucket;
+    }
+    return pBucket;
+}
+
+/*************************************************
+ * SLAB POOL :: ALLOCATE
+ * Reuse a freed block if we have one, otherwise take
+ * the next block of the newest slab, starting a new
+ * slab when that one is used up
+ ************************************************/
+inline void * SlabPool :: allocate(size_t size, size_t align)
+{
+    size_t sizeBlock = blockSize(size, align);
+    if (sizeBlock == 0)
+        return ::operator new(size);
+
+    Bucket* pBucket = findBucket(sizeBlock);
+    Block* pBlock = pBucket->pFree;
+    if (pBlock)
+        pBucket->pFree = pBlock->pNextFree;
+    else
+    {
+        if (pBucket->pNext == nullptr || size_t(pBucket->pEnd - pBucket->pNext) < sizeBlock)
+        {
+            Slab* pSlab = static_cast<Slab *>(::operator new(SLAB_SIZE));
+            pSlab->pNextSlab = pSlabs;
+            pSlabs = pSlab;
+            pBucket->pNext = reinterpret_cast<char *>(pSlab) + slabHeader();
+            pBucket->pEnd = reinterpret_cast<char *>(pSlab) + SLAB_SIZE;
+        }
+        pBlock = reinterpret_cast<Block *>(pBucket->pNext);
+        pBucket->pNext += sizeBlock;
+    }
+    return pBlock;
+}
+
+/*************************************************
+ * SLAB POOL :: DEALLOCATE
+ * Put the block on its free list. The slab itself
+ * stays until release()
+ ************************************************/
+inline void SlabPool :: deallocate(void * p, size_t size, size_t align) noexcept
 {
-    if (pThis == nullptr)
+    size = blockSize(size, align);
+    if (size == 0)
+    {
+        ::operator delete(p);
         return;
-    if(pThis->pLeft != nullptr)
-        clear(pThis->pLeft);
-    if (pThis->pRight != nullptr)
-        clear(pThis->pRight);
-    pThis = nullptr;
+    }
+
+    Bucket* pBucket = pBuckets;
+    while (pBucket->size != size)
+        pBucket = pBucket->pNextBucket;
+    Block* pBlock = static_cast<Block *>(p);
+    pBlock->pNextFree = pBucket->pFree;
+    pBucket->pFree = pBlock;
+}
+
+/*************************************************
+ * SLAB POOL :: RELEASE
+ * Free every slab at once. Anything still allocated
+ * from this pool, through any copy, is gone after this
+ ************************************************/
+inline void SlabPool :: release() noexcept
+{
+    while (pSlabs)
+    {
+        Slab* pSlab = pSlabs;
+        pSlabs = pSlab->pNextSlab;
+        ::operator delete(pSlab);
+    }
+    for (Bucket* pBucket = pBuckets; pBucket; pBucket = pBucket->pNextBucket)
+    {
+        pBucket->pFree = nullptr;
+        pBucket->pNext = pBucket->pEnd = nullptr;
+    }
+}
+
+inline SlabPool :: ~SlabPool()
+{
+    release();
+    while (pBuckets)
+    {
+        Bucket* pBucket = pBuckets;
+        pBuckets = pBucket->pNextBucket;
+        delete pBucket;
+    }
+}
+
+/*************************************************
+ * WORKER POOL :: INSTANCE
+ * The one pool every BST shares, started on first use
+ ************************************************/
+inline WorkerPool & WorkerPool :: instance()
+{
+    static WorkerPool pool;
+    return pool;
+}
+
+/*************************************************
+ * WORKER POOL :: CONSTRUCTOR
+ * One thread for every core but the one that waits.
+ * If threads cannot be had, waiting threads do the
+ * work themselves
+ ************************************************/
+inline WorkerPool :: WorkerPool() : isStopping(false)
+{
+    unsigned numThreads = std::max(2u, std::thread::hardware_concurrency()) - 1;
+    try
+    {
+        while (threads.size() < numThreads)
+            threads.push_back(std::thread(&WorkerPool::serve, this));
+    }
+    catch (...)
+    {
+    }
+}
+
+inline WorkerPool :: ~WorkerPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        isStopping = true;
+    }
+    isChanged.notify_all();
+    for (std::thread & thread : threads)
+        thread.join();
+}
+
+/*************************************************
+ * WORKER POOL :: SERVE
+ * What each thread does: run tasks until told to stop
+ ************************************************/
+inline void WorkerPool :: serve()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true)
+    {
+        isChanged.wait(lock, [this]() { return isStopping || !tasks.empty(); });
+        if (tasks.empty())
+            return;
+        runTask(lock);
+    }
+}
+
+/*************************************************
+ * WORKER POOL :: RUN TASK
+ * Take the oldest task and run it with the lock let
+ * go. Anything it throws goes to its group
+ ************************************************/
+inline void WorkerPool :: runTask(std::unique_lock<std::mutex> & lock)
+{
+    Task task = std::move(tasks.front());
+    tasks.pop_front();
+    lock.unlock();
+
+    std::exception_ptr pFailed;
+    try
+    {
+        task.work();
+    }
+    catch (...)
+    {
+        pFailed = std::current_exception();
+    }
+
+    lock.lock();
+    if (pFailed && !task.pGroup->pError)
+        task.pGroup->pError = pFailed;
+    task.pGroup->numLeft--;
+    isChanged.notify_all();
+}
+
+/*************************************************
+ * WORKER POOL :: FINISH
+ * Wait for everything queued in a group, running
+ * queued tasks (anyone's) in the meantime
+ ************************************************/
+inline void WorkerPool :: finish(Group & group) noexcept
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    while (group.numLeft != 0)
+    {
+        if (tasks.empty())
+            isChanged.wait(lock);
+        else
+            runTask(lock);
+    }
+}
+
+/*************************************************
+ * WORKER POOL :: GROUP :: RUN
+ * Queue work for whichever thread gets to it first.
+ * If it cannot be queued, it is done right here
+ ************************************************/
+template <typename Work>
+void WorkerPool::Group :: run(Work work)
+{
+    try
+    {
+        std::lock_guard<std::mutex> lock(pool.mutex);
+        pool.tasks.push_back(Task{ this, std::function<void()>(work) });
+        numLeft++;
+    }
+    catch (...)
+    {
+        call(work);
+        return;
+    }
+    pool.isChanged.notify_all();
+}
+
+/*************************************************
+ * WORKER POOL :: GROUP :: CALL
+ * Do the work on this thread. What it throws is
+ * kept for wait(), as for queued work
+ ************************************************/
+template <typename Work>
+void WorkerPool::Group :: call(Work work)
+{
+    try
+    {
+        work();
+    }
+    catch (...)
+    {
+        fail(std::current_exception());
+    }
+}
+
+inline void WorkerPool::Group :: fail(std::exception_ptr pFailed)
+{
+    std::lock_guard<std::mutex> lock(pool.mutex);
+    if (!pError)
+        pError = pFailed;
+}
+
+/*************************************************
+ * WORKER POOL :: GROUP :: WAIT
+ * Wait for every task in the group, then pass on the
+ * first exception any of them threw
+ ************************************************/
+inline void WorkerPool::Group :: wait()
+{
+    pool.finish(*this);
+    std::exception_ptr pFailed;
+    std::swap(pFailed, pError);
+    if (pFailed)
+        std::rethrow_exception(pFailed);
 }
 
 
@@ -20,6 +20,67 @@
 #include <iostream>
 #include <string>
 #include <functional> // for std::less and std::greater
+#include <thread>     // for std::thread
+#include <vector>     // for std::vector
+#include <atomic>     // for std::atomic
+
+ /***********************************************
+  * COUNTING ALLOCATOR
+  * An allocator that records how many times the
+  * BST asked it for memory and gave memory back
+  ***********************************************/
+template <typename T>
+class CountingAllocator
+{
+public:
+   typedef T value_type;
+   CountingAllocator() {}
+   template <typename U>
+   CountingAllocator(const CountingAllocator<U> &) {}
+
+   T * allocate(size_t n)
+   {
+      numAllocate++;
+      return static_cast<T *>(::operator new(n * sizeof(T)));
+   }
+   void deallocate(T * p, size_t)
+   {
+      numDeallocate++;
+      ::operator delete(p);
+   }
+
+   bool operator == (const CountingAllocator &) const { return true;  }
+   bool operator != (const CountingAllocator &) const { return false; }
+
+   static void reset() { numAllocate = numDeallocate = 0; }
+   static std::atomic<int> numAllocate;     // set operations may allocate from several threads
+   static std::atomic<int> numDeallocate;
+};
+template <typename T> std::atomic<int> CountingAllocator<T>::numAllocate(0);
+template <typename T> std::atomic<int> CountingAllocator<T>::numDeallocate(0);
+
+ /***********************************************
+  * RECORD
+  * A value keyed by an id, with a transparent
+  * comparator so the BST can be searched by id
+  * alone. Counts how many records get built
+  ***********************************************/
+struct Record
+{
+   Record(unsigned long long id) : id(id) { numConstruct++; }
+   Record(const Record & rhs) : id(rhs.id) { numConstruct++; }
+   unsigned long long id;
+   static int numConstruct;
+};
+int Record::numConstruct = 0;
+
+struct RecordById
+{
+   typedef void is_transparent;
+   bool operator () (const Record & lhs, const Record & rhs) const { return lhs.id < rhs.id; }
+   bool operator () (const Record & lhs, unsigned long long id) const { return lhs.id < id; }
+   bool operator () (unsigned long long id, const Record & rhs) const { return id < rhs.id; }
+};
 
  /***********************************************
   * TEST BST
@@ -35,6 +96,12 @@ public:
 
       // Construct
       test_construct_default();
+      test_construct_comparator();
+      test_construct_allocator();
+      test_construct_rangeSorted();
+      test_construct_parallelBulkLoad();
+      test_construct_parallelBulkLoadUnique();
+      test_construct_parallelBulkLoadUniqueOdd();
       test_constructCopy_empty();
       test_constructCopy_one();
       test_constructCopy_standard();
@@ -49,6 +116,8 @@ public:
       test_assign_oneToStandard();
       test_assign_standardToOne();
       test_assign_standardToStandard();
+      test_assign_recycleDifferentShape();
+      test_assign_initializerListUnsorted();
       test_assignMove_emptyToEmpty();
       test_assignMove_standardToEmpty();
       test_assignMove_emptyToStandard();
@@ -64,6 +133,9 @@ public:
       test_begin_empty();
       test_begin_standard();
       test_end_standard();
+      test_end_decrement();
+      test_rbegin_standard();
+      test_begin_cachedAfterErase();
       test_iterator_increment_standardToParent();
       test_iterator_increment_standardToChild();
       test_iterator_increment_standardToGrandma();
@@ -77,16 +149,40 @@ public:
       test_find_standardBegin();
       test_find_standardLast();
       test_find_standardMissing();
+      test_find_constTree();
+      test_find_constTreeConcurrent();
+      test_lowerBound_standard();
+      test_upperBound_standard();
+      test_equalRange_duplicates();
+      test_findBatch_standard();
+      test_findBatch_matchesFind();
+      test_freeze_standard();
+      test_freeze_matchesTree();
+      test_find_transparentKey();
+      test_erase_transparentKey();
+      test_select_afterInsertErase();
+      test_rank_duplicates();
+      test_advance_bothWays();
       
       // Insert
       test_insert_oneLeft();
       test_insert_oneRight();
       test_insert_duplicate();
       test_insert_keepUnique();
+      test_insert_empty();
+      test_insert_standardLeaf();
+      test_insert_sortedBalanced();
       test_insertMove_oneLeft();
       test_insertMove_oneRight();
       test_insertMove_duplicate();
       test_insertMove_keepUnique();
+      test_emplace_inPlace();
+      test_emplace_uniqueDuplicate();
+      test_insertHint_sortedEnd();
+      test_insertHint_sortedLast();
+      test_insertHint_wrongHint();
+      test_insertRange_batch();
+      test_insertRange_keepUnique();
       
       // Remove
       test_erase_empty();
@@ -94,8 +190,37 @@ public:
       test_erase_noChildren();
       test_erase_oneChild();
       test_erase_twoChildren();
+      test_erase_keepsBalanced();
       test_clear_empty();
       test_clear_standard();
+      test_clear_pool();
+      test_clear_degenerate();
+      test_erase_poolReuse();
+      test_clear_poolShared();
+      test_eraseRange_bulk();
+      test_eraseRange_duplicates();
+      test_extract_insertOtherTree();
+      test_extract_uniqueDuplicate();
+      test_extract_insertOtherPool();
+      test_extract_outlivesTree();
+      test_merge_disjoint();
+      test_merge_overlapKeepUnique();
+      test_merge_keepUniqueDuplicates();
+      test_merge_emptySteal();
+      test_split_counted();
+      test_split_nearEnds();
+      test_split_poolRelinks();
+      test_split_duplicates();
+      test_join_ordered();
+      test_join_subtree();
+
+      // Set operations
+      test_setUnion_copyOnce();
+      test_setIntersection_moveIn();
+      test_setDifference_multiset();
+      test_setUnion_parallel();
+      test_setIntersection_parallelPoolDuplicates();
+      test_setSymmetricDifference_parallelMoveIn();
       
       // Status
       test_empty_empty();
@@ -127,6 +252,155 @@ public:
       assertEmptyFixture(bst);
    }  // teardown
 
+   // a custom comparator changes the order and a stateless one takes no room
+   void test_construct_comparator()
+   {  // setup
+      custom::BST<int, std::greater<int>> bst;
+      // exercise
+      bst.insert(20);
+      bst.insert(50);
+      bst.insert(30);
+      // verify
+      assertUnit(sizeof(bst) == sizeof(custom::BST<int>));   // the comparator takes no room
+      assertUnit(bst.numElements == 3);
+      auto it = bst.begin();
+      assertUnit(it != bst.end() && *it == 50);
+      ++it;
+      assertUnit(it != bst.end() && *it == 30);
+      ++it;
+      assertUnit(it != bst.end() && *it == 20);
+      ++it;
+      assertUnit(it == bst.end());
+      assertUnit(bst.find(30) != bst.end());
+      assertUnit(bst.find(40) == bst.end());
+   }  // teardown
+
+   // every node comes from and goes back to the allocator we provide
+   void test_construct_allocator()
+   {  // setup
+      typedef custom::BST<int, std::less<int>, CountingAllocator<int>> BSTCount;
+      typedef CountingAllocator<BSTCount::BNode> NodeCount;
+      NodeCount::reset();
+      {
+         BSTCount bst;
+         // exercise
+         bst.insert(50);
+         bst.insert(30);
+         bst.insert(70);
+         BSTCount bstCopy(bst);
+         auto it = bstCopy.find(30);
+         bstCopy.erase(it);
+         // verify
+         assertUnit(NodeCount::numAllocate == 6);
+         assertUnit(NodeCount::numDeallocate == 1);
+      }  // teardown
+      assertUnit(NodeCount::numAllocate == 6);
+      assertUnit(NodeCount::numDeallocate == 6);
+      // a stateless allocator takes up no room; a stateful one only its own
+      typedef custom::BST<int, std::less<int>, custom::PoolAllocator<int>> BSTPool;
+      assertUnit(sizeof(BSTCount) + sizeof(custom::PoolAllocator<int>) == sizeof(BSTPool));
+   }
+
+   // construct from a sorted range: one copy each, only the sortedness check compares
+   void test_construct_rangeSorted()
+   {  // setup
+      std::vector<Spy> v;
+      for (int i = 1; i <= 1000; i++)
+         v.push_back(Spy(i));
+      Spy::reset();
+      // exercise
+      custom::BST <Spy> bst(v.begin(), v.end());
+      // verify
+      assertUnit(Spy::numCopy() == 1000);
+      assertUnit(Spy::numLessthan() == 999);  // is it sorted?
+      assertUnit(Spy::numEquals() == 0);
+      assertUnit(Spy::numAssign() == 0);
+      assertUnit(bst.numElements == 1000);
+      assertUnit(height(bst.root) == 10);     // as short as it can be
+      assertUnit(blackHeight(bst.root) > 0);
+      assertUnit(bst.root != nullptr && bst.root->isRed == false);
+      assertUnit(bst.root != nullptr && bst.root->pParent == nullptr);
+      int expected = 1;
+      for (auto it = bst.begin(); it != bst.end(); ++it)
+         assertUnit((*it).get() == expected++);
+      assertUnit(expected == 1001);
+   }  // teardown
+
+   // bulk loading over threads copies each element once into a balanced tree
+   void test_construct_parallelBulkLoad()
+   {  // setup
+      std::vector<int> v;
+      for (int i = 0; i < 100000; i++)
+         v.push_back((i * 7919) % 100000);       // every number, shuffled
+      // exercise
+      custom::BST <int> bst(v.begin(), v.end(), 4);
+      // verify
+      assertUnit(bst.size() == 100000);
+      assertUnit(blackHeight(bst.root) > 0);
+      assertUnit(height(bst.root) == 17);      // as short as 100000 nodes can be
+      assertUnit(bst.root->pParent == nullptr);
+      int expected = 0;
+      bool isOrdered = true;
+      for (auto it = bst.begin(); it != bst.end(); ++it)
+         isOrdered = isOrdered && *it == expected++;
+      assertUnit(isOrdered);
+      assertUnit(expected == 100000);
+   }  // teardown
+
+   // bulk loading keeps the first of each run of equal elements when asked
+   void test_construct_parallelBulkLoadUnique()
+   {  // setup
+      struct ByKey
+      {
+         bool operator () (const std::pair<int, int> & lhs, const std::pair<int, int> & rhs) const { return lhs.first < rhs.first; }
+      };
+      std::vector<std::pair<int, int>> v;        // (key, position), each key three times
+      for (int i = 0; i < 30000; i++)
+         v.push_back(std::make_pair((i * 7919) % 10000, i));
+      // exercise
+      custom::BST <std::pair<int, int>, ByKey> bst(v.begin(), v.end(), 0, true);
+      // verify
+      assertUnit(bst.size() == 10000);
+      assertUnit(blackHeight(bst.root) > 0);
+      bool isFirst = true;
+      int expected = 0;
+      for (auto it = bst.begin(); it != bst.end(); ++it, expected++)
+         isFirst = isFirst && (*it).first == expected && (*it).second == (expected * 7679) % 10000;
+      assertUnit(isFirst);
+      assertUnit(expected == 10000);
+   }  // teardown
+
+   // over an odd number of threads the last merge is shared out too, and runs
+   // of equal elements cut by a block boundary still keep only their first
+   void test_construct_parallelBulkLoadUniqueOdd()
+   {  // setup
+      struct ByKey
+      {
+         bool operator () (const std::pair<int, int> & lhs, const std::pair<int, int> & rhs) const { return lhs.first < rhs.first; }
+      };
+      std::vector<std::pair<int, int>> v;        // (key, position), each key thirty times
+      std::vector<int> firstAt(2000, -1);
+      for (int i = 0; i < 60000; i++)
+      {
+         int key = (i * 7919) % 2000;
+         v.push_back(std::make_pair(key, i));
+         if (firstAt[key] < 0)
+            firstAt[key] = i;
+      }
+      // exercise
+      custom::BST <std::pair<int, int>, ByKey> bst(v.begin(), v.end(), 5, true);
+      // verify
+      assertUnit(bst.size() == 2000);
+      assertUnit(blackHeight(bst.root) > 0);
+      assertUnit(bst.root->pParent == nullptr);
+      bool isFirst = true;
+      int expected = 0;
+      for (auto it = bst.begin(); it != bst.end(); ++it, expected++)
+         isFirst = isFirst && (*it).first == expected && (*it).second == firstAt[expected];
+      assertUnit(isFirst);
+      assertUnit(expected == 2000);
+   }  // teardown
+
    /***************************************
     * COPY CONSTRUCTOR
     ***************************************/
@@ -712,6 +986,88 @@ public:
    }
 
 
+   // assignment operator : standard = seven elements in another shape
+   void test_assign_recycleDifferentShape()
+   {  // setup
+      //                (50) = bstSrc
+      //          +-------+-------+
+      //        (30)            (70)
+      //     +----+----+     +----+----+
+      //   (20)       (40) (60)       (80)
+      custom::BST <Spy> bstSrc;
+      setupStandardFixture(bstSrc);
+      //   (1) = bstDest
+      //    +--+
+      //      (2) ...
+      //           +--+
+      //             (7)
+      custom::BST <Spy> bstDest;
+      custom::BST <Spy>::BNode* pNodes[7];
+      for (int i = 0; i < 7; i++)
+      {
+         pNodes[i] = new custom::BST<Spy>::BNode(Spy(i + 1));
+         if (i > 0)
+            pNodes[i - 1]->addRight(pNodes[i]);
+      }
+      bstDest.root = pNodes[0];
+      bstDest.numElements = 7;
+      Spy::reset();
+      // exercise
+      bstDest = bstSrc;
+      // verify
+      assertUnit(Spy::numAssign() == 7);      // assign [20][30][40][50][60][70][80]
+      assertUnit(Spy::numCopy() == 0);
+      assertUnit(Spy::numAlloc() == 0);
+      assertUnit(Spy::numDestructor() == 0);
+      assertUnit(Spy::numDelete() == 0);
+      assertUnit(Spy::numEquals() == 0);
+      assertUnit(Spy::numLessthan() == 0);
+      // every destination node was reused
+      int numReused = 0;
+      for (auto it = bstDest.begin(); it != bstDest.end(); ++it)
+         for (int i = 0; i < 7; i++)
+            if (it.pNode == pNodes[i])
+               numReused++;
+      assertUnit(numReused == 7);
+      //                (50)
+      //          +-------+-------+
+      //        (30)            (70)
+      //     +----+----+     +----+----+
+      //   (20)       (40) (60)       (80)
+      assertStandardFixture(bstSrc);
+      assertStandardFixture(bstDest);
+      // teardown
+      teardownStandardFixture(bstSrc);
+      teardownStandardFixture(bstDest);
+   }
+
+   // assign an unsorted initializer list: sorted, then built balanced
+   void test_assign_initializerListUnsorted()
+   {  // setup
+      custom::BST <Spy> bst;
+      bst.insert(Spy(99));
+      std::initializer_list<Spy> il = { Spy(40), Spy(80), Spy(20), Spy(50), Spy(70), Spy(30), Spy(60) };
+      Spy::reset();
+      // exercise
+      bst = il;
+      // verify
+      assertUnit(Spy::numAssign() == 1);      // [99] recycled
+      assertUnit(Spy::numCopy() == 6);
+      assertUnit(Spy::numCopyMove() == 0);
+      assertUnit(Spy::numAssignMove() == 0);
+      assertUnit(Spy::numDestructor() == 0);
+      assertUnit(Spy::numEquals() == 0);
+      //                (50)
+      //          +-------+-------+
+      //        (30)            (70)
+      //     +----+----+     +----+----+
+      //   (20)       (40) (60)       (80)
+      assertStandardFixture(bst);
+      assertUnit(blackHeight(bst.root) > 0);
+      // teardown
+      teardownStandardFixture(bst);
+   }
+
    /***************************************
     * Assignment-Move
     *    BST::operator=(BST &&)
@@ -1120,128 +1476,945 @@ public:
       assertEmptyFixture(bst);
    }  // teardown
 
-   /***************************************
-    * Iterator
-    *     BST::begin()
-    *     BST::end()
-    *     BST::iterator::operator++()
-    *     BST::iterator::operator*()
-    ***************************************/
+   // clear a tree that is one long zig-zag, far too deep to recurse through
+   void test_clear_degenerate()
+   {  // setup
+      //    (0)
+      //     +--+
+      //       (n)
+      //     +--+
+      //    (1)
+      //     +--+
+      //      (n-1) ...
+      const int num = 1000000;
+      custom::BST <int> bst;
+      custom::BST<int>::BNode* pLow = new custom::BST<int>::BNode(0);
+      custom::BST<int>::BNode* pHigh = nullptr;
+      bst.root = pLow;
+      for (int i = 1; i < num / 2; i++)
+      {
+         pHigh = new custom::BST<int>::BNode(num - i);
+         pLow->addRight(pHigh);
+         pLow = new custom::BST<int>::BNode(i);
+         pHigh->addLeft(pLow);
+      }
+      bst.numElements = num - 1;
+      // exercise
+      bst.clear();
+      // verify
+      assertUnit(bst.root == nullptr);
+      assertUnit(bst.numElements == 0);
+   }  // teardown
 
-   // begin() from an empty BST
-   void test_begin_empty()
+   // clear a tree whose nodes come from a pool
+   void test_clear_pool()
    {  // setup
-      custom::BST<Spy> bst;
-      custom::BST<Spy>::iterator it;
+      custom::BST <Spy, std::less<Spy>, custom::PoolAllocator<Spy>> bst;
+      for (int i = 1; i <= 100; i++)
+         bst.insert(Spy(i));
       Spy::reset();
       // exercise
-      it = bst.begin();
+      bst.clear();
       // verify
-      assertUnit(Spy::numLessthan() == 0);    // does not look at any element
-      assertUnit(Spy::numEquals() == 0);      // does not look at any element
-      assertUnit(Spy::numDestructor() == 0);
-      assertUnit(Spy::numDelete() == 0);     
+      assertUnit(Spy::numDestructor() == 100); // destroy every value
+      assertUnit(Spy::numDelete() == 100);     // delete every value
       assertUnit(Spy::numAssign() == 0);
       assertUnit(Spy::numCopy() == 0);
       assertUnit(Spy::numAlloc() == 0);
-      assertUnit(Spy::numDefault() == 0);
-      assertUnit(Spy::numNondefault() == 0);
-      assertUnit(Spy::numCopyMove() == 0);
-      assertUnit(Spy::numAssignMove() == 0);
-      assertUnit(it.pNode == nullptr);
-      assertUnit(it == bst.end());
-      assertEmptyFixture(bst);
+      assertUnit(Spy::numLessthan() == 0);
+      assertUnit(bst.root == nullptr);
+      assertUnit(bst.numElements == 0);
+      // the pool is empty again so the tree is still usable
+      bst.insert(Spy(1));
+      assertUnit(bst.numElements == 1);
    }  // teardown
 
-   // begin() from the standard fixture
-   void test_begin_standard()
+   // an erased node's memory is handed out for the next insert
+   void test_erase_poolReuse()
    {  // setup
-      //                 50 
-      //          +-------+-------+
-      //         30              70  
-      //     +----+----+     +----+----+
-      //    20        40    60        80  
-      custom::BST <Spy> bst;
-      setupStandardFixture(bst);
-      custom::BST<Spy>::iterator it;
-      Spy::reset();
+      custom::BST <int, std::less<int>, custom::PoolAllocator<int>> bst;
+      for (int i = 1; i <= 10; i++)
+         bst.insert(i);
+      auto it = bst.find(5);
+      const void * pFreed = it.pNode;
       // exercise
-      it = bst.begin();
+      bst.erase(it);
+      auto pairBST = bst.insert(99);
       // verify
-      assertUnit(Spy::numLessthan() == 0);    // does not look at any element
-      assertUnit(Spy::numEquals() == 0);      // does not look at any element
-      assertUnit(Spy::numDestructor() == 0);
-      assertUnit(Spy::numDelete() == 0);
-      assertUnit(Spy::numAssign() == 0);
-      assertUnit(Spy::numCopy() == 0);
-      assertUnit(Spy::numAlloc() == 0);
-      assertUnit(Spy::numDefault() == 0);
-      assertUnit(Spy::numNondefault() == 0);
-      assertUnit(Spy::numCopyMove() == 0);
-      assertUnit(Spy::numAssignMove() == 0);
-      assertUnit(it.pNode != nullptr);
-      assertUnit(bst.root != nullptr && bst.root->pLeft != nullptr);
-      if (it.pNode && bst.root && bst.root->pLeft)
-         assertUnit(it.pNode == bst.root->pLeft->pLeft);
-      if (it.pNode)
-         assertUnit(it.pNode->data == Spy(20));
-      assertStandardFixture(bst);
-      // teardown
-      teardownStandardFixture(bst);
+      assertUnit(pairBST.first.pNode == pFreed);
+      assertUnit(bst.numElements == 10);
+      assertUnit(blackHeight(bst.root) > 0);
    }
 
-   // end() from the standard fixture.
-   void test_end_standard()
+   // copies and rebinds of a pool share it: they compare equal and free
+   // each other's memory, and clearing one tree leaves the other alone
+   void test_clear_poolShared()
+   {  // setup
+      typedef custom::BST<int, std::less<int>, custom::PoolAllocator<int>> BSTPool;
+      custom::PoolAllocator<int> pool;
+      custom::PoolAllocator<int> poolCopy(pool);
+      custom::PoolAllocator<double> poolRebound(pool);
+      custom::PoolAllocator<int> poolOther;
+      int * pInt = poolCopy.allocate(1);
+      double * pDouble = poolRebound.allocate(1);
+      pool.deallocate(pInt, 1);
+      custom::PoolAllocator<double>(poolCopy).deallocate(pDouble, 1);
+      BSTPool bstFirst(pool);
+      BSTPool bstSecond(pool);
+      for (int i = 1; i <= 100; i++)
+      {
+         bstFirst.insert(i);
+         bstSecond.insert(-i);
+      }
+      // exercise
+      bstFirst.clear();
+      // verify
+      assertUnit(pool == poolCopy);
+      assertUnit(pool == poolRebound);
+      assertUnit(!(pool == poolOther));
+      assertUnit(bstFirst.get_allocator() == pool);
+      assertUnit(bstFirst.empty());
+      assertUnit(bstSecond.size() == 100);
+      int expected = -100;
+      for (auto it = bstSecond.begin(); it != bstSecond.end(); ++it)
+         assertUnit(*it == expected++);
+      assertUnit(expected == 0);
+      bstFirst.insert(1);
+      assertUnit(bstFirst.size() == 1);
+   }  // teardown
+
+   // a range is cut out and freed in one go, not erased node by node
+   void test_eraseRange_bulk()
    {  // setup
-      //                 50 
-      //          +-------+-------+
-      //         30              70  
-      //     +----+----+     +----+----+
-      //    20        40    60        80  
       custom::BST <Spy> bst;
-      setupStandardFixture(bst);
-      custom::BST<Spy>::iterator it;
+      for (int i = 1; i <= 1000; i++)
+         bst.insert(Spy(i));
+      auto itFirst = bst.find(Spy(201));
+      auto itLast = bst.find(Spy(701));
       Spy::reset();
       // exercise
-      it = bst.end();
+      auto it = bst.erase(itFirst, itLast);
       // verify
-      assertUnit(Spy::numLessthan() == 0);    // does not look at any element
-      assertUnit(Spy::numEquals() == 0);      // does not look at any element
-      assertUnit(Spy::numDestructor() == 0);
-      assertUnit(Spy::numDelete() == 0);
+      assertUnit(Spy::numDestructor() == 500);
+      assertUnit(Spy::numDelete() == 500);
+      assertUnit(Spy::numCopy() == 0);
       assertUnit(Spy::numAssign() == 0);
+      assertUnit(Spy::numLessthan() == 0);     // cut by position, not by key
+      assertUnit(it != bst.end() && (*it).get() == 701);
+      assertUnit(bst.size() == 500);
+      assertUnit(blackHeight(bst.root) > 0);
+      assertUnit(bst.root->pParent == nullptr);
+      int expected = 1;
+      for (auto itCheck = bst.begin(); itCheck != bst.end(); ++itCheck, expected++)
+      {
+         if (expected == 201)
+            expected = 701;
+         assertUnit((*itCheck).get() == expected);
+      }
+      assertUnit(expected == 1001);
+   }  // teardown
+
+   // erase_range takes every equal key at lo and none at hi
+   void test_eraseRange_duplicates()
+   {  // setup
+      custom::BST <int> bst { 1, 2, 2, 2, 3, 3, 4, 5 };
+      // exercise
+      size_t num = bst.erase_range(2, 3);
+      size_t numNone = bst.erase_range(4, 4);
+      size_t numTail = bst.erase_range(4, 100);
+      // verify
+      assertUnit(num == 3);
+      assertUnit(numNone == 0);
+      assertUnit(numTail == 2);
+      assertUnit(bst.size() == 3);              // 1 3 3
+      assertUnit(bst.count(3) == 2);
+      assertUnit(*--bst.end() == 3);
+      assertUnit(blackHeight(bst.root) > 0);
+   }  // teardown
+
+   // move a node from one tree to another without allocating or copying
+   void test_extract_insertOtherTree()
+   {  // setup
+      typedef custom::BST<Spy, std::less<Spy>, CountingAllocator<Spy>> BSTCount;
+      typedef CountingAllocator<BSTCount::BNode> NodeCount;
+      BSTCount bstHot;
+      BSTCount bstCold;
+      for (int i : { 50, 30, 70, 20, 40 })
+         bstHot.insert(Spy(i));
+      bstCold.insert(Spy(35));
+      Spy s30(30);
+      NodeCount::reset();
+      Spy::reset();
+      // exercise
+      BSTCount::node_type nh = bstHot.extract(s30);
+      BSTCount::BNode * pNode = nh.pNode;
+      auto result = bstCold.insert(std::move(nh));
+      // verify
+      assertUnit(NodeCount::numAllocate == 0);
+      assertUnit(NodeCount::numDeallocate == 0);
       assertUnit(Spy::numCopy() == 0);
-      assertUnit(Spy::numAlloc() == 0);
-      assertUnit(Spy::numDefault() == 0);
-      assertUnit(Spy::numNondefault() == 0);
       assertUnit(Spy::numCopyMove() == 0);
-      assertUnit(Spy::numAssignMove() == 0);
-      assertUnit(it.pNode == nullptr);
-      assertStandardFixture(bst);
-      // teardown
-      teardownStandardFixture(bst);
+      assertUnit(Spy::numAssign() == 0);
+      assertUnit(Spy::numDestructor() == 0);
+      assertUnit(result.inserted);
+      assertUnit(result.position.pNode == pNode);
+      assertUnit(result.node.empty());
+      assertUnit(nh.empty());
+      assertUnit(bstHot.size() == 4);
+      assertUnit(bstHot.find(s30) == bstHot.end());
+      assertUnit(blackHeight(bstHot.root) > 0);
+      assertUnit(bstCold.size() == 2);
+      assertUnit(*bstCold.begin() == s30);
+      assertUnit(blackHeight(bstCold.root) > 0);
+   }  // teardown
+
+   // a duplicate turned away hands the node back; dropping it frees it
+   void test_extract_uniqueDuplicate()
+   {  // setup
+      typedef custom::BST<int, std::less<int>, CountingAllocator<int>> BSTCount;
+      typedef CountingAllocator<BSTCount::BNode> NodeCount;
+      BSTCount bstSrc;
+      BSTCount bstDest;
+      bstSrc.insert(40);
+      bstDest.insert(40);
+      NodeCount::reset();
+      // exercise
+      BSTCount::node_type nhMissing = bstSrc.extract(99);
+      auto result = bstDest.insert(bstSrc.extract(40), true /*keepUnique*/);
+      // verify
+      assertUnit(nhMissing.empty());
+      assertUnit(!result.inserted);
+      assertUnit(result.position == bstDest.begin());
+      assertUnit(!result.node.empty() && result.node.value() == 40);
+      assertUnit(bstSrc.empty());
+      assertUnit(bstDest.size() == 1);
+      result.node = BSTCount::node_type();
+      assertUnit(NodeCount::numAllocate == 0);
+      assertUnit(NodeCount::numDeallocate == 1);
+   }  // teardown
+
+   // a handle keeps its own allocator, so the tree it came from can be
+   // moved away or destroyed while the handle lives on
+   static custom::BST<int, std::less<int>, custom::PoolAllocator<int>>::node_type extractFromLocal(int value)
+   {
+      custom::BST<int, std::less<int>, custom::PoolAllocator<int>> bst { 10, 20, 30 };
+      return bst.extract(value);
    }
+   void test_extract_outlivesTree()
+   {  // setup
+      typedef custom::BST<int, std::less<int>, custom::PoolAllocator<int>> BSTPool;
+      BSTPool bstSrc { 1, 2, 3 };
+      BSTPool::node_type nhMoved = bstSrc.extract(2);
+      BSTPool::node_type nhCleared = bstSrc.extract(3);
+      // exercise
+      BSTPool bstMoved(std::move(bstSrc));
+      bstMoved.clear();
+      BSTPool::node_type nhReturned = extractFromLocal(20);
+      nhMoved.value() = 5;
+      auto result = bstMoved.insert(std::move(nhMoved));
+      nhCleared = BSTPool::node_type();
+      // verify
+      assertUnit(result.inserted);
+      assertUnit(bstMoved.size() == 1 && *bstMoved.begin() == 5);
+      assertUnit(nhCleared.empty());
+      assertUnit(!nhReturned.empty() && nhReturned.value() == 20);
+      nhReturned = BSTPool::node_type();
+      assertUnit(nhReturned.empty());
+   }  // teardown
 
-   // increment where the next node is the parent
-   void test_iterator_increment_standardToParent()
+   // pools never compare equal, so the value moves into a new node and
+   // the old node goes back to the pool it came from
+   void test_extract_insertOtherPool()
    {  // setup
-      //                 50 
-      //          +-------+-------+
-      //         30              70  
-      //     +----+----+     +----+----+
-      //  [[20]]      40    60        80  
-      custom::BST <Spy> bst;
-      setupStandardFixture(bst);
-      custom::BST<Spy>::iterator it;
-      it.pNode = bst.root->pLeft->pLeft;
+      typedef custom::BST<Spy, std::less<Spy>, custom::PoolAllocator<Spy>> BSTPool;
+      BSTPool bstSrc;
+      BSTPool bstDest;
+      for (int i : { 50, 30, 70 })
+         bstSrc.insert(Spy(i));
+      bstDest.insert(Spy(35));
+      Spy s30(30);
+      BSTPool::node_type nh = bstSrc.extract(s30);
+      const void * pFreed = nh.pNode;
       Spy::reset();
       // exercise
-      ++it;
+      auto result = bstDest.insert(std::move(nh));
       // verify
-      assertUnit(Spy::numLessthan() == 0);    // does not look at any element
-      assertUnit(Spy::numEquals() == 0);      // does not look at any element
-      assertUnit(Spy::numDestructor() == 0);
-      assertUnit(Spy::numDelete() == 0);
+      assertUnit(Spy::numCopy() == 0);
+      assertUnit(Spy::numCopyMove() == 1);
+      assertUnit(Spy::numDestructor() == 1);    // the moved-from value
+      assertUnit(result.inserted);
+      assertUnit(result.position != bstDest.end() && *result.position == s30);
+      assertUnit(result.position.pNode != pFreed);
+      assertUnit(result.node.empty());
+      assertUnit(nh.empty());
+      assertUnit(bstDest.size() == 2);
+      assertUnit(*bstDest.begin() == s30);
+      assertUnit(blackHeight(bstDest.root) > 0);
+      // the source pool has the old node to hand out again
+      auto pairSrc = bstSrc.insert(Spy(99));
+      assertUnit(pairSrc.first.pNode == pFreed);
+      assertUnit(bstSrc.size() == 3);
+   }  // teardown
+
+   // trees that do not overlap are joined, not merged one node at a time
+   void test_merge_disjoint()
+   {  // setup
+      custom::BST <Spy> bstLow;
+      custom::BST <Spy> bstHigh;
+      for (int i = 1; i <= 100; i++)
+         bstLow.insert(Spy(i));
+      for (int i = 101; i <= 300; i++)
+         bstHigh.insert(Spy(i));
+      custom::BST<Spy>::BNode * pHighRoot = bstHigh.root;
+      Spy::reset();
+      // exercise
+      bstLow.merge(bstHigh);
+      // verify
+      assertUnit(Spy::numLessthan() == 1);    // compare [100][101]
+      assertUnit(Spy::numCopy() == 0);
+      assertUnit(Spy::numCopyMove() == 0);
+      assertUnit(Spy::numAlloc() == 0);
+      assertUnit(Spy::numDestructor() == 0);
+      assertUnit(bstLow.size() == 300);
+      assertUnit(bstHigh.empty());
+      assertUnit(bstHigh.root == nullptr);
+      assertUnit(blackHeight(bstLow.root) > 0);
+      assertUnit(bstLow.root != nullptr && bstLow.root->isRed == false);
+      assertUnit(height(bstLow.root) <= 18);  // 2 log2(301)
+      int expected = 1;
+      bool isRootMoved = false;
+      for (auto it = bstLow.begin(); it != bstLow.end(); ++it)
+      {
+         assertUnit((*it).get() == expected++);
+         isRootMoved = isRootMoved || it.pNode == pHighRoot;
+      }
+      assertUnit(expected == 301);
+      assertUnit(isRootMoved);
+   }  // teardown
+
+   // overlapping trees merge node by node; duplicates stay behind
+   void test_merge_overlapKeepUnique()
+   {  // setup
+      typedef custom::BST<int, std::less<int>, CountingAllocator<int>> BSTCount;
+      typedef CountingAllocator<BSTCount::BNode> NodeCount;
+      BSTCount bstDest;
+      BSTCount bstSrc;
+      for (int i : { 50, 30, 70, 20, 40, 60, 80 })
+         bstDest.insert(i);
+      for (int i : { 35, 40, 65, 80, 85 })
+         bstSrc.insert(i);
+      NodeCount::reset();
+      // exercise
+      bstDest.merge(bstSrc, true /*keepUnique*/);
+      // verify
+      assertUnit(NodeCount::numAllocate == 0);
+      assertUnit(NodeCount::numDeallocate == 0);
+      assertUnit(bstDest.size() == 10);
+      assertUnit(bstSrc.size() == 2);
+      assertUnit(bstSrc.count(40) == 1 && bstSrc.count(80) == 1);
+      assertUnit(bstDest.count(35) == 1 && bstDest.count(65) == 1 && bstDest.count(85) == 1);
+      assertUnit(blackHeight(bstDest.root) > 0);
+      assertUnit(blackHeight(bstSrc.root) > 0);
+      int previous = 0;
+      for (auto it = bstDest.begin(); it != bstDest.end(); ++it)
+      {
+         assertUnit(*it > previous);
+         previous = *it;
+      }
+   }  // teardown
+
+   // with keepUnique the second of two equal elements in rhs stays
+   // behind, whether or not rhs sorts after this tree
+   void test_merge_keepUniqueDuplicates()
+   {  // setup
+      custom::BST <int> bstDisjoint { 1, 2, 3 };
+      custom::BST <int> bstOverlap { 1, 2, 30 };
+      custom::BST <int> bstSrcDisjoint { 10, 10, 11 };
+      custom::BST <int> bstSrcOverlap { 10, 10, 11 };
+      // exercise
+      bstDisjoint.merge(bstSrcDisjoint, true /*keepUnique*/);
+      bstOverlap.merge(bstSrcOverlap, true /*keepUnique*/);
+      // verify
+      assertUnit(bstDisjoint.size() == 5);
+      assertUnit(bstDisjoint.count(10) == 1);
+      assertUnit(bstSrcDisjoint.size() == 1 && *bstSrcDisjoint.begin() == 10);
+      assertUnit(bstOverlap.size() == 5);
+      assertUnit(bstOverlap.count(10) == 1);
+      assertUnit(bstSrcOverlap.size() == 1 && *bstSrcOverlap.begin() == 10);
+      assertUnit(blackHeight(bstDisjoint.root) > 0);
+      assertUnit(blackHeight(bstSrcDisjoint.root) > 0);
+   }  // teardown
+
+   // an empty tree takes the other's nodes whole: no comparisons at all
+   void test_merge_emptySteal()
+   {  // setup
+      typedef custom::BST<Spy, std::less<Spy>, std::allocator<Spy>, true> BSTCounted;
+      custom::BST <Spy> bstDest;
+      custom::BST <Spy> bstSrc;
+      BSTCounted bstLow;
+      BSTCounted bstHigh;
+      for (int i = 1; i <= 100; i++)
+      {
+         bstSrc.insert(Spy(i));
+         bstHigh.insert(Spy(i));
+      }
+      custom::BST<Spy>::BNode * pSrcRoot = bstSrc.root;
+      BSTCounted::BNode * pHighRoot = bstHigh.root;
+      Spy::reset();
+      // exercise
+      bstDest.merge(bstSrc);
+      BSTCounted bst = BSTCounted::join(std::move(bstLow), std::move(bstHigh));
+      // verify
+      assertUnit(Spy::numLessthan() == 0);
+      assertUnit(Spy::numCopy() == 0);
+      assertUnit(Spy::numCopyMove() == 0);
+      assertUnit(bstDest.root == pSrcRoot);
+      assertUnit(bstDest.size() == 100);
+      assertUnit(bstSrc.root == nullptr && bstSrc.empty());
+      assertUnit(bstSrc.begin() == bstSrc.end());
+      assertUnit(bst.root == pHighRoot);
+      assertUnit(bst.size() == 100);
+      assertUnit(bstHigh.empty());
+      assertUnit((*bstDest.begin()).get() == 1 && (*--bstDest.end()).get() == 100);
+      assertUnit((*bst.begin()).get() == 1 && (*--bst.end()).get() == 100);
+   }  // teardown
+
+   // split along the search path: one comparison per level, no copies
+   void test_split_counted()
+   {  // setup
+      typedef custom::BST<Spy, std::less<Spy>, std::allocator<Spy>, true> BSTCounted;
+      BSTCounted bst;
+      for (int i = 1; i <= 1000; i++)
+         bst.insert(Spy(i));
+      Spy key(400);
+      Spy::reset();
+      // exercise
+      BSTCounted bstHigh = bst.split(key);
+      // verify
+      assertUnit(Spy::numLessthan() <= 20);   // one per level
+      assertUnit(Spy::numCopy() == 0);
+      assertUnit(Spy::numCopyMove() == 0);
+      assertUnit(Spy::numAlloc() == 0);
+      assertUnit(bst.size() == 399);
+      assertUnit(bstHigh.size() == 601);
+      assertUnit(bst.root != nullptr && bst.root->getCount() == 399);
+      assertUnit(blackHeight(bst.root) > 0);
+      assertUnit(blackHeight(bstHigh.root) > 0);
+      assertUnit((*bst.rbegin()).get() == 399);
+      assertUnit((*bstHigh.begin()).get() == 400);
+      assertUnit((*bstHigh.select(100)).get() == 500);
+   }  // teardown
+
+   // a cut near either end sizes both halves without walking either
+   void test_split_nearEnds()
+   {  // setup
+      typedef custom::BST<Spy, std::less<Spy>, std::allocator<Spy>, true> BSTCounted;
+      BSTCounted bstLowCut;
+      BSTCounted bstHighCut;
+      for (int i = 1; i <= 1000; i++)
+      {
+         bstLowCut.insert(Spy(i));
+         bstHighCut.insert(Spy(i));
+      }
+      Spy keyLow(3);
+      Spy keyHigh(998);
+      Spy::reset();
+      // exercise
+      BSTCounted bstLowRest = bstLowCut.split(keyLow);
+      BSTCounted bstHighRest = bstHighCut.split(keyHigh);
+      // verify
+      assertUnit(Spy::numLessthan() <= 40);   // one per level, nothing else
+      assertUnit(Spy::numCopy() == 0);
+      assertUnit(bstLowCut.size() == 2);
+      assertUnit(bstLowRest.size() == 998);
+      assertUnit(bstHighCut.size() == 997);
+      assertUnit(bstHighRest.size() == 3);
+      assertUnit((*bstLowRest.begin()).get() == 3);
+      assertUnit((*bstHighCut.rbegin()).get() == 997);
+      assertUnit(blackHeight(bstLowCut.root) > 0);
+      assertUnit(blackHeight(bstHighRest.root) > 0);
+   }  // teardown
+
+   // trees on one pool hand nodes over rather than moving values
+   void test_split_poolRelinks()
+   {  // setup
+      typedef custom::BST<Spy, std::less<Spy>, custom::PoolAllocator<Spy>, true> BSTPool;
+      BSTPool bst;
+      for (int i = 1; i <= 100; i++)
+         bst.insert(Spy(i));
+      BSTPool::BNode * p80 = bst.find(Spy(80)).pNode;
+      Spy key(50);
+      Spy::reset();
+      // exercise
+      BSTPool bstHigh = bst.split(key);
+      BSTPool bstBack(bst.get_allocator());
+      bstBack.merge(bstHigh);
+      // verify
+      assertUnit(Spy::numCopy() == 0);
+      assertUnit(Spy::numCopyMove() == 0);
+      assertUnit(Spy::numAlloc() == 0);
+      assertUnit(bst.size() == 49);
+      assertUnit(bstHigh.empty());
+      assertUnit(bstBack.size() == 51);
+      assertUnit(bstBack.find(Spy(80)).pNode == p80);
+      assertUnit(blackHeight(bstBack.root) > 0);
+   }  // teardown
+
+   // every copy of the key goes to the upper half
+   void test_split_duplicates()
+   {  // setup
+      typedef custom::BST<int, std::less<int>, std::allocator<int>, true> BSTCounted;
+      BSTCounted bst;
+      for (int i : { 5, 3, 7, 5, 1, 5, 9, 5 })
+         bst.insert(i);
+      // exercise
+      BSTCounted bstHigh = bst.split(5);
+      // verify
+      assertUnit(bst.size() == 2);
+      assertUnit(bstHigh.size() == 6);
+      assertUnit(bst.count(5) == 0);
+      assertUnit(bstHigh.count(5) == 4);
+      assertUnit(*bst.begin() == 1 && *bst.rbegin() == 3);
+      assertUnit(*bstHigh.begin() == 5 && *bstHigh.rbegin() == 9);
+      assertUnit(blackHeight(bst.root) > 0);
+      assertUnit(blackHeight(bstHigh.root) > 0);
+   }  // teardown
+
+   // join two ordered trees back into one
+   void test_join_ordered()
+   {  // setup
+      typedef custom::BST<int, std::less<int>, std::allocator<int>, true> BSTCounted;
+      BSTCounted bstLow;
+      BSTCounted bstHigh;
+      for (int i = 1; i <= 10; i++)
+         bstLow.insert(i);
+      for (int i = 11; i <= 1000; i++)
+         bstHigh.insert(i);
+      // exercise
+      BSTCounted bst = BSTCounted::join(std::move(bstLow), std::move(bstHigh));
+      // verify
+      assertUnit(bst.size() == 1000);
+      assertUnit(bstLow.empty());
+      assertUnit(bstHigh.empty());
+      assertUnit(blackHeight(bst.root) > 0);
+      assertUnit(height(bst.root) <= 20);
+      int expected = 1;
+      for (auto it = bst.begin(); it != bst.end(); ++it)
+         assertUnit(*it == expected++);
+      assertUnit(expected == 1001);
+   }  // teardown
+
+   // joining detached pieces hands back the new top; no tree is touched
+   void test_join_subtree()
+   {  // setup
+      //   [10]  (20)            [40]
+      //                          +--+
+      //                            (50)
+      typedef custom::BST<int>::BNode BNode;
+      custom::BST <int> bst { 1, 2, 3 };
+      BNode* pRoot = bst.root;
+      BNode* p10 = new BNode(10);
+      BNode* p20 = new BNode(20);
+      BNode* p30 = new BNode(30);
+      BNode* p40 = new BNode(40);
+      BNode* p50 = new BNode(50);
+      p10->isRed = false;
+      p40->isRed = false;
+      p40->addRight(p50);
+      size_t heightShort;
+      size_t heightEqual;
+      // exercise
+      BNode* pLow = custom::BST<int>::join(p10, 1, p20, nullptr, 0, heightShort);
+      BNode* pTop = custom::BST<int>::join(pLow, heightShort, p30, p40, 1, heightEqual);
+      // verify
+      //          [30]
+      //       +---+---+
+      //     [10]     [40]
+      //       +--+     +--+
+      //         (20)     (50)
+      assertUnit(bst.root == pRoot);
+      assertUnit(bst.size() == 3);
+      assertUnit(pLow == p10 && heightShort == 1);
+      assertUnit(pTop == p30 && heightEqual == 2);
+      assertUnit(pTop->pParent == nullptr && !pTop->isRed);
+      assertUnit(blackHeight(pTop) == 3);     // the empty leaves count too
+      int expected = 10;
+      for (BNode* p = BNode::first(pTop); p; p = BNode::next(p), expected += 10)
+         assertUnit(p->data == expected);
+      assertUnit(expected == 60);
+      // teardown
+      delete p10;
+      delete p20;
+      delete p30;
+      delete p40;
+      delete p50;
+   }
+
+   /***************************************
+    * SET OPERATIONS
+    *    BST::set_union()
+    *    BST::set_intersection()
+    *    BST::set_difference()
+    *    BST::set_symmetric_difference()
+    ***************************************/
+
+   // union walks both trees once and copies each element it keeps once
+   void test_setUnion_copyOnce()
+   {  // setup
+      custom::BST <Spy> bstEven;
+      custom::BST <Spy> bstThree;
+      for (int i = 2; i <= 200; i += 2)
+         bstEven.insert(Spy(i));                  // 100 elements
+      for (int i = 3; i <= 200; i += 3)
+         bstThree.insert(Spy(i));                 // 66 elements, 33 shared
+      Spy::reset();
+      // exercise
+      custom::BST <Spy> bst = custom::BST<Spy>::set_union(bstEven, bstThree);
+      // verify
+      assertUnit(Spy::numCopy() == 133);
+      assertUnit(Spy::numLessthan() <= 2 * (100 + 66));
+      assertUnit(Spy::numAssign() == 0);
+      assertUnit(bst.size() == 133);
+      assertUnit(bstEven.size() == 100);
+      assertUnit(bstThree.size() == 66);
+      assertUnit(blackHeight(bst.root) > 0);
+      assertUnit(height(bst.root) == 8);       // as short as 133 nodes can be
+      int previous = 0;
+      for (auto it = bst.begin(); it != bst.end(); ++it)
+      {
+         assertUnit((*it).get() > previous);
+         assertUnit((*it).get() % 2 == 0 || (*it).get() % 3 == 0);
+         previous = (*it).get();
+      }
+   }  // teardown
+
+   // the move-in version relinks the nodes it keeps and frees the rest
+   void test_setIntersection_moveIn()
+   {  // setup
+      typedef custom::BST<int, std::less<int>, CountingAllocator<int>> BSTCount;
+      typedef CountingAllocator<BSTCount::BNode> NodeCount;
+      BSTCount bstEven;
+      BSTCount bstThree;
+      for (int i = 2; i <= 60; i += 2)
+         bstEven.insert(i);                       // 30 elements
+      for (int i = 3; i <= 60; i += 3)
+         bstThree.insert(i);                      // 20 elements, 10 shared
+      NodeCount::reset();
+      // exercise
+      BSTCount bst = BSTCount::set_intersection(std::move(bstEven), std::move(bstThree));
+      // verify
+      assertUnit(NodeCount::numAllocate == 0);
+      assertUnit(NodeCount::numDeallocate == 40);
+      assertUnit(bst.size() == 10);
+      assertUnit(bstEven.empty() && bstEven.root == nullptr);
+      assertUnit(bstThree.empty() && bstThree.root == nullptr);
+      assertUnit(blackHeight(bst.root) > 0);
+      int expected = 6;
+      for (auto it = bst.begin(); it != bst.end(); ++it, expected += 6)
+         assertUnit(*it == expected);
+      assertUnit(expected == 66);
+   }  // teardown
+
+   // duplicates pair off one for one, like std::set_difference
+   void test_setDifference_multiset()
+   {  // setup
+      custom::BST <int> bstLeft  { 1, 2, 2, 2, 3, 5 };
+      custom::BST <int> bstRight { 2, 3, 3, 4 };
+      // exercise
+      custom::BST <int> bstDiff = custom::BST<int>::set_difference(bstLeft, bstRight);
+      custom::BST <int> bstSym  = custom::BST<int>::set_symmetric_difference(bstLeft, bstRight);
+      // verify
+      assertUnit(bstDiff.size() == 4);            // 1 2 2 5
+      assertUnit(bstDiff.count(2) == 2);
+      assertUnit(bstDiff.count(3) == 0);
+      assertUnit(bstSym.size() == 6);             // 1 2 2 3 4 5
+      assertUnit(bstSym.count(2) == 2);
+      assertUnit(bstSym.count(3) == 1);
+      assertUnit(bstSym.count(4) == 1);
+      assertUnit(blackHeight(bstDiff.root) > 0);
+      assertUnit(blackHeight(bstSym.root) > 0);
+   }  // teardown
+
+   // spread over threads, union still gives just what one thread does
+   void test_setUnion_parallel()
+   {  // setup
+      custom::BST <int> bstEven;
+      custom::BST <int> bstThree;
+      for (int i = 0; i < 60000; i += 2)
+         bstEven.insert(i % 7 == 0 ? i - 1 : i);  // a few odd keys and repeats
+      for (int i = 0; i < 60000; i += 3)
+         bstThree.insert(i);
+      custom::BST <int> bstSequential = custom::BST<int>::set_union(bstEven, bstThree);
+      // exercise
+      custom::BST <int> bst = custom::BST<int>::set_union(bstEven, bstThree, 4);
+      // verify
+      assertUnit(bst.size() == bstSequential.size());
+      assertUnit(blackHeight(bst.root) == blackHeight(bstSequential.root));
+      assertUnit(height(bst.root) == height(bstSequential.root));
+      assertUnit(std::equal(bst.begin(), bst.end(), bstSequential.begin()));
+      assertUnit(bst.root->pParent == nullptr);
+      assertUnit(bstEven.size() == 30000);
+   }  // teardown
+
+   // spread over threads, long runs of equal keys still pair off one for one,
+   // and a pool that is not thread safe is only used by one thread at a time
+   void test_setIntersection_parallelPoolDuplicates()
+   {  // setup
+      typedef custom::BST<int, std::less<int>, custom::PoolAllocator<int>> BSTPool;
+      custom::PoolAllocator<int> pool;
+      BSTPool bstLeft(pool);
+      BSTPool bstRight(pool);
+      for (int i = 0; i < 40000; i++)
+         bstLeft.insert((i * 7919) % 1000);       // every key 40 times
+      for (int i = 0; i < 40000; i++)
+         bstRight.insert(i % 2000);               // every key 20 times, half of them not in bstLeft
+      BSTPool bstCopy = BSTPool::set_intersection(bstLeft, bstRight, 4);
+      // exercise
+      BSTPool bst = BSTPool::set_intersection(std::move(bstLeft), std::move(bstRight), 4);
+      // verify
+      assertUnit(bst.size() == 20000);
+      assertUnit(bstCopy.size() == 20000);
+      assertUnit(bst.get_allocator() == pool);
+      assertUnit(bstLeft.empty() && bstRight.empty());
+      assertUnit(blackHeight(bst.root) > 0);
+      assertUnit(blackHeight(bstCopy.root) > 0);
+      assertUnit(bst.root->pParent == nullptr);
+      assertUnit(std::equal(bst.begin(), bst.end(), bstCopy.begin()));
+      bool isPaired = true;
+      for (int key = 0; key < 1000; key += 97)
+         isPaired = isPaired && bst.count(key) == 20;
+      assertUnit(isPaired);
+      assertUnit(*bst.begin() == 0);
+      assertUnit(*bst.rbegin() == 999);
+   }  // teardown
+
+   // spread over threads, the move-in version still allocates nothing
+   void test_setSymmetricDifference_parallelMoveIn()
+   {  // setup
+      typedef custom::BST<int, std::less<int>, CountingAllocator<int>> BSTCount;
+      typedef CountingAllocator<BSTCount::BNode> NodeCount;
+      BSTCount bstEven;
+      BSTCount bstThree;
+      for (int i = 2; i <= 60000; i += 2)
+         bstEven.insert(i);                       // 30000 elements
+      for (int i = 3; i <= 60000; i += 3)
+         bstThree.insert(i);                      // 20000 elements, 10000 shared
+      NodeCount::reset();
+      // exercise
+      BSTCount bst = BSTCount::set_symmetric_difference(std::move(bstEven), std::move(bstThree), 0);
+      // verify
+      assertUnit(NodeCount::numAllocate == 0);
+      assertUnit(NodeCount::numDeallocate == 20000);
+      assertUnit(bst.size() == 30000);
+      assertUnit(bstEven.empty() && bstEven.root == nullptr);
+      assertUnit(bstThree.empty() && bstThree.root == nullptr);
+      assertUnit(blackHeight(bst.root) > 0);
+      int previous = 0;
+      bool isOrdered = true;
+      for (auto it = bst.begin(); it != bst.end(); ++it)
+      {
+         isOrdered = isOrdered && *it > previous && (*it % 2 == 0) != (*it % 3 == 0);
+         previous = *it;
+      }
+      assertUnit(isOrdered);
+   }  // teardown
+
+   /***************************************
+    * Iterator
+    *     BST::begin()
+    *     BST::end()
+    *     BST::iterator::operator++()
+    *     BST::iterator::operator*()
+    ***************************************/
+
+   // begin() from an empty BST
+   void test_begin_empty()
+   {  // setup
+      custom::BST<Spy> bst;
+      custom::BST<Spy>::iterator it;
+      Spy::reset();
+      // exercise
+      it = bst.begin();
+      // verify
+      assertUnit(Spy::numLessthan() == 0);    // does not look at any element
+      assertUnit(Spy::numEquals() == 0);      // does not look at any element
+      assertUnit(Spy::numDestructor() == 0);
+      assertUnit(Spy::numDelete() == 0);     
+      assertUnit(Spy::numAssign() == 0);
+      assertUnit(Spy::numCopy() == 0);
+      assertUnit(Spy::numAlloc() == 0);
+      assertUnit(Spy::numDefault() == 0);
+      assertUnit(Spy::numNondefault() == 0);
+      assertUnit(Spy::numCopyMove() == 0);
+      assertUnit(Spy::numAssignMove() == 0);
+      assertUnit(it.pNode == nullptr);
+      assertUnit(it == bst.end());
+      assertEmptyFixture(bst);
+   }  // teardown
+
+   // begin() from the standard fixture
+   void test_begin_standard()
+   {  // setup
+      //                 50 
+      //          +-------+-------+
+      //         30              70  
+      //     +----+----+     +----+----+
+      //    20        40    60        80  
+      custom::BST <Spy> bst;
+      setupStandardFixture(bst);
+      custom::BST<Spy>::iterator it;
+      Spy::reset();
+      // exercise
+      it = bst.begin();
+      // verify
+      assertUnit(Spy::numLessthan() == 0);    // does not look at any element
+      assertUnit(Spy::numEquals() == 0);      // does not look at any element
+      assertUnit(Spy::numDestructor() == 0);
+      assertUnit(Spy::numDelete() == 0);
+      assertUnit(Spy::numAssign() == 0);
+      assertUnit(Spy::numCopy() == 0);
+      assertUnit(Spy::numAlloc() == 0);
+      assertUnit(Spy::numDefault() == 0);
+      assertUnit(Spy::numNondefault() == 0);
+      assertUnit(Spy::numCopyMove() == 0);
+      assertUnit(Spy::numAssignMove() == 0);
+      assertUnit(it.pNode != nullptr);
+      assertUnit(bst.root != nullptr && bst.root->pLeft != nullptr);
+      if (it.pNode && bst.root && bst.root->pLeft)
+         assertUnit(it.pNode == bst.root->pLeft->pLeft);
+      if (it.pNode)
+         assertUnit(it.pNode->data == Spy(20));
+      assertStandardFixture(bst);
+      // teardown
+      teardownStandardFixture(bst);
+   }
+
+   // end() from the standard fixture.
+   void test_end_standard()
+   {  // setup
+      //                 50 
+      //          +-------+-------+
+      //         30              70  
+      //     +----+----+     +----+----+
+      //    20        40    60        80  
+      custom::BST <Spy> bst;
+      setupStandardFixture(bst);
+      custom::BST<Spy>::iterator it;
+      Spy::reset();
+      // exercise
+      it = bst.end();
+      // verify
+      assertUnit(Spy::numLessthan() == 0);    // does not look at any element
+      assertUnit(Spy::numEquals() == 0);      // does not look at any element
+      assertUnit(Spy::numDestructor() == 0);
+      assertUnit(Spy::numDelete() == 0);
+      assertUnit(Spy::numAssign() == 0);
+      assertUnit(Spy::numCopy() == 0);
+      assertUnit(Spy::numAlloc() == 0);
+      assertUnit(Spy::numDefault() == 0);
+      assertUnit(Spy::numNondefault() == 0);
+      assertUnit(Spy::numCopyMove() == 0);
+      assertUnit(Spy::numAssignMove() == 0);
+      assertUnit(it.pNode == nullptr);
+      assertStandardFixture(bst);
+      // teardown
+      teardownStandardFixture(bst);
+   }
+
+   // stepping back from the end lands on the largest element
+   void test_end_decrement()
+   {  // setup
+      //                 50 
+      //          +-------+-------+
+      //         30              70  
+      //     +----+----+     +----+----+
+      //    20        40    60        80  
+      custom::BST <Spy> bst;
+      setupStandardFixture(bst);
+      custom::BST<Spy>::iterator it = bst.end();
+      Spy::reset();
+      // exercise
+      --it;
+      // verify
+      assertUnit(Spy::numLessthan() == 0);
+      assertUnit(Spy::numCopy() == 0);
+      assertUnit(it.pNode == bst.root->pRight->pRight);
+      --it;
+      assertUnit(it.pNode == bst.root->pRight);
+      assertStandardFixture(bst);
+      // teardown
+      teardownStandardFixture(bst);
+   }
+
+   // walk the tree backwards
+   void test_rbegin_standard()
+   {  // setup
+      //                 50 
+      //          +-------+-------+
+      //         30              70  
+      //     +----+----+     +----+----+
+      //    20        40    60        80  
+      custom::BST <Spy> bst;
+      setupStandardFixture(bst);
+      Spy::reset();
+      // exercise
+      int values[7];
+      int count = 0;
+      for (auto it = bst.rbegin(); it != bst.rend() && count < 7; ++it)
+         values[count++] = (*it).get();
+      // verify
+      assertUnit(count == 7);
+      assertUnit(values[0] == 80);
+      assertUnit(values[3] == 50);
+      assertUnit(values[6] == 20);
+      assertUnit(Spy::numLessthan() == 0);
+      assertUnit(Spy::numCopy() == 0);
+      assertStandardFixture(bst);
+      // teardown
+      teardownStandardFixture(bst);
+   }
+
+   // the cached ends follow inserts and erases
+   void test_begin_cachedAfterErase()
+   {  // setup
+      custom::BST <int> bst;
+      for (int i = 50; i <= 100; i++)
+         bst.insert(i);
+      for (int i = 49; i >= 1; i--)
+         bst.insert(i);
+      auto it = bst.begin();
+      // exercise
+      bst.erase(it);
+      it = bst.end();
+      --it;
+      bst.erase(it);
+      // verify
+      assertUnit(bst.pFirst != nullptr && bst.pFirst->data == 2);
+      assertUnit(bst.pLast  != nullptr && bst.pLast->data  == 99);
+      assertUnit(*bst.begin() == 2);
+      assertUnit(*bst.rbegin() == 99);
+   }  // teardown
+
+   // increment where the next node is the parent
+   void test_iterator_increment_standardToParent()
+   {  // setup
+      //                 50 
+      //          +-------+-------+
+      //         30              70  
+      //     +----+----+     +----+----+
+      //  [[20]]      40    60        80  
+      custom::BST <Spy> bst;
+      setupStandardFixture(bst);
+      custom::BST<Spy>::iterator it;
+      it.pNode = bst.root->pLeft->pLeft;
+      Spy::reset();
+      // exercise
+      ++it;
+      // verify
+      assertUnit(Spy::numLessthan() == 0);    // does not look at any element
+      assertUnit(Spy::numEquals() == 0);      // does not look at any element
+      assertUnit(Spy::numDestructor() == 0);
+      assertUnit(Spy::numDelete() == 0);
       assertUnit(Spy::numAssign() == 0);
       assertUnit(Spy::numCopy() == 0);
       assertUnit(Spy::numAlloc() == 0);
@@ -1550,8 +2723,8 @@ public:
       // exercise
       it = bst.find(s);
       // verify
-      assertUnit(Spy::numEquals() == 3);      // check [50][30][20]
-      assertUnit(Spy::numLessthan() == 2);    // compare [50][30]
+      assertUnit(Spy::numLessthan() == 4);    // compare [50][30][20] then check [20]
+      assertUnit(Spy::numEquals() == 0);
       assertUnit(Spy::numDestructor() == 0);
       assertUnit(Spy::numDelete() == 0);
       assertUnit(Spy::numAssign() == 0);
@@ -1593,8 +2766,8 @@ public:
       // exercise
       it = bst.find(s);
       // verify
-      assertUnit(Spy::numEquals() == 3);      // check [50][70][80]
-      assertUnit(Spy::numLessthan() == 2);    // compare [50][70]
+      assertUnit(Spy::numLessthan() == 4);    // compare [50][70][80] then check [80]
+      assertUnit(Spy::numEquals() == 0);
       assertUnit(Spy::numDestructor() == 0);
       assertUnit(Spy::numDelete() == 0);
       assertUnit(Spy::numAssign() == 0);
@@ -1620,8 +2793,215 @@ public:
       teardownStandardFixture(bst);
    }
 
-   // attempt to find something where it is not there
-   void test_find_standardMissing()
+   // attempt to find something where it is not there
+   void test_find_standardMissing()
+   {  // setup
+      //                 50 
+      //          +-------+-------+
+      //         30              70  
+      //     +----+----+     +----+----+
+      //    20        40    60        80  
+      custom::BST <Spy> bst;
+      setupStandardFixture(bst);
+      custom::BST<Spy>::iterator it;
+      Spy s(42);
+      Spy::reset();
+      // exercise
+      it = bst.find(s);
+      // verify
+      assertUnit(Spy::numLessthan() == 4);    // compare [50][30][40] then check [50]
+      assertUnit(Spy::numEquals() == 0);
+      assertUnit(Spy::numDestructor() == 0);
+      assertUnit(Spy::numDelete() == 0);
+      assertUnit(Spy::numAssign() == 0);
+      assertUnit(Spy::numCopy() == 0);
+      assertUnit(Spy::numAlloc() == 0);
+      assertUnit(Spy::numDefault() == 0);
+      assertUnit(Spy::numNondefault() == 0);
+      assertUnit(Spy::numCopyMove() == 0);
+      assertUnit(Spy::numAssignMove() == 0);
+      assertUnit(it == bst.end());
+      assertStandardFixture(bst);
+      // teardown
+      teardownStandardFixture(bst);
+   }
+
+   // a reader with only a const reference can search and walk the tree
+   void test_find_constTree()
+   {  // setup
+      //                 50 
+      //          +-------+-------+
+      //         30              70  
+      //     +----+----+     +----+----+
+      //    20        40    60        80  
+      custom::BST <Spy> bst;
+      setupStandardFixture(bst);
+      const custom::BST <Spy> & bstConst = bst;
+      Spy s60(60);
+      Spy s65(65);
+      Spy::reset();
+      // exercise
+      custom::BST<Spy>::const_iterator itFound = bstConst.find(s60);
+      custom::BST<Spy>::const_iterator itLower = bstConst.lower_bound(s65);
+      int sum = 0;
+      for (custom::BST<Spy>::const_iterator it = bstConst.cbegin(); it != bstConst.cend(); ++it)
+         sum += (*it).get();
+      // verify
+      assertUnit(itFound != bstConst.cend() && (*itFound).get() == 60);
+      assertUnit(itLower != bstConst.cend() && (*itLower).get() == 70);
+      assertUnit(sum == 350);
+      assertUnit(bstConst.crbegin() != bstConst.crend() && (*bstConst.crbegin()).get() == 80);
+      assertUnit(Spy::numCopy() == 0);
+      assertStandardFixture(bst);
+      // teardown
+      teardownStandardFixture(bst);
+   }
+
+   // several threads can read a freshly copied tree at once: nothing
+   // const writes to the tree, not even the cached first and last
+   void test_find_constTreeConcurrent()
+   {  // setup
+      custom::BST <int> bstSrc;
+      for (int i = 0; i < 1000; i++)
+         bstSrc.insert((i * 7919) % 1000);
+      const custom::BST <int> bst(bstSrc);
+      const int numThreads = 4;
+      bool isOK[numThreads] = {};
+      std::vector<std::thread> readers;
+      // exercise
+      for (int t = 0; t < numThreads; t++)
+         readers.push_back(std::thread([&bst, &isOK, t]()
+         {
+            bool ok = *bst.begin() == 0 && *bst.rbegin() == 999 && *--bst.end() == 999;
+            int expected = 0;
+            for (auto it = bst.cbegin(); it != bst.cend(); ++it, expected++)
+               ok = ok && *it == expected;
+            for (int i = 0; i < 1000; i++)
+               ok = ok && bst.find(i) != bst.cend();
+            ok = ok && bst.freeze().size() == 1000;
+            isOK[t] = ok && expected == 1000;
+         }));
+      for (std::thread& reader : readers)
+         reader.join();
+      // verify
+      for (int t = 0; t < numThreads; t++)
+         assertUnit(isOK[t]);
+      assertUnit(bst.size() == 1000);
+   }  // teardown
+
+   /***************************************
+    * Bounds
+    *    BST::lower_bound(const T &)
+    *    BST::upper_bound(const T &)
+    *    BST::equal_range(const T &)
+    ***************************************/
+
+   // lower bound of a value in the tree is that value
+   void test_lowerBound_standard()
+   {  // setup
+      //                 50 
+      //          +-------+-------+
+      //         30              70  
+      //     +----+----+     +----+----+
+      //    20        40    60        80  
+      custom::BST <Spy> bst;
+      setupStandardFixture(bst);
+      Spy s40(40);
+      Spy s85(85);
+      Spy::reset();
+      // exercise
+      custom::BST<Spy>::iterator it = bst.lower_bound(s40);
+      // verify
+      assertUnit(Spy::numLessthan() == 3);    // compare [50][30][40]
+      assertUnit(Spy::numEquals() == 0);
+      assertUnit(Spy::numCopy() == 0);
+      assertUnit(it != bst.end() && (*it).get() == 40);
+      assertUnit(bst.lower_bound(s85) == bst.end());
+      assertStandardFixture(bst);
+      // teardown
+      teardownStandardFixture(bst);
+   }
+
+   // upper bound of a value in the tree is the one after it
+   void test_upperBound_standard()
+   {  // setup
+      //                 50 
+      //          +-------+-------+
+      //         30              70  
+      //     +----+----+     +----+----+
+      //    20        40    60        80  
+      custom::BST <Spy> bst;
+      setupStandardFixture(bst);
+      Spy s40(40);
+      Spy s10(10);
+      Spy::reset();
+      // exercise
+      custom::BST<Spy>::iterator it = bst.upper_bound(s40);
+      // verify
+      assertUnit(Spy::numLessthan() == 3);    // compare [50][30][40]
+      assertUnit(Spy::numEquals() == 0);
+      assertUnit(Spy::numCopy() == 0);
+      assertUnit(it != bst.end() && (*it).get() == 50);
+      it = bst.upper_bound(s10);
+      assertUnit(it != bst.end() && (*it).get() == 20);
+      assertStandardFixture(bst);
+      // teardown
+      teardownStandardFixture(bst);
+   }
+
+   // equal range covers every duplicate and nothing else
+   void test_equalRange_duplicates()
+   {  // setup
+      custom::BST <int> bst;
+      for (int i : { 5, 3, 7, 5, 1, 5, 9, 5 })
+         bst.insert(i);
+      // exercise
+      auto range = bst.equal_range(5);
+      auto missing = bst.equal_range(6);
+      // verify
+      int count = 0;
+      for (auto it = range.first; it != range.second; ++it, ++count)
+         assertUnit(*it == 5);
+      assertUnit(count == 4);
+      assertUnit(range.second != bst.end() && *range.second == 7);
+      assertUnit(missing.first == missing.second);
+      assertUnit(missing.first != bst.end() && *missing.first == 7);
+   }  // teardown
+
+   // a batch of lookups costs the same comparisons as one find() each
+   void test_findBatch_standard()
+   {  // setup
+      //                 50 
+      //          +-------+-------+
+      //         30              70  
+      //     +----+----+     +----+----+
+      //    20        40    60        80  
+      custom::BST <Spy> bst;
+      setupStandardFixture(bst);
+      std::vector<Spy> keys { Spy(20), Spy(35), Spy(80), Spy(50), Spy(99) };
+      std::vector<custom::BST<Spy>::iterator> results;
+      Spy::reset();
+      // exercise
+      bst.find_batch(keys.begin(), keys.end(), std::back_inserter(results));
+      // verify
+      assertUnit(Spy::numLessthan() == 4 + 4 + 4 + 4 + 3);  // 3 levels and a check, or off the end
+      assertUnit(Spy::numCopy() == 0);
+      assertUnit(results.size() == 5);
+      if (results.size() == 5)
+      {
+         assertUnit(results[0] == bst.find(Spy(20)));
+         assertUnit(results[1] == bst.end());
+         assertUnit(results[2] == bst.find(Spy(80)));
+         assertUnit(results[3] == custom::BST<Spy>::iterator(bst.root));
+         assertUnit(results[4] == bst.end());
+      }
+      assertStandardFixture(bst);
+      // teardown
+      teardownStandardFixture(bst);
+   }
+
+   // freezing lays the standard fixture out level by level, one copy each
+   void test_freeze_standard()
    {  // setup
       //                 50 
       //          +-------+-------+
@@ -1630,30 +3010,218 @@ public:
       //    20        40    60        80  
       custom::BST <Spy> bst;
       setupStandardFixture(bst);
-      custom::BST<Spy>::iterator it;
-      Spy s(42);
       Spy::reset();
       // exercise
-      it = bst.find(s);
+      custom::FrozenBST <Spy> frozen = bst.freeze();
       // verify
-      assertUnit(Spy::numEquals() == 3);      // check [50][30][40]
-      assertUnit(Spy::numLessthan() == 3);    // compare [50][30][40]
-      assertUnit(Spy::numDestructor() == 0);
-      assertUnit(Spy::numDelete() == 0);
+      assertUnit(Spy::numCopy() == 7);
       assertUnit(Spy::numAssign() == 0);
-      assertUnit(Spy::numCopy() == 0);
-      assertUnit(Spy::numAlloc() == 0);
-      assertUnit(Spy::numDefault() == 0);
-      assertUnit(Spy::numNondefault() == 0);
-      assertUnit(Spy::numCopyMove() == 0);
-      assertUnit(Spy::numAssignMove() == 0);
-      assertUnit(it == bst.end());
+      assertUnit(Spy::numLessthan() <= 6);    // only assert() checking the order
+      assertUnit(frozen.size() == 7);
+      assertUnit(frozen.keys.size() == 7);
+      if (frozen.keys.size() == 7)
+      {
+         assertUnit(frozen.keys[0] == Spy(50));
+         assertUnit(frozen.keys[1] == Spy(30));
+         assertUnit(frozen.keys[2] == Spy(70));
+         assertUnit(frozen.keys[3] == Spy(20));
+         assertUnit(frozen.keys[4] == Spy(40));
+         assertUnit(frozen.keys[5] == Spy(60));
+         assertUnit(frozen.keys[6] == Spy(80));
+      }
+      Spy::reset();
+      auto it = frozen.lower_bound(Spy(35));
+      assertUnit(Spy::numLessthan() == 3);    // compare [50][30][40]
+      assertUnit(it != frozen.end() && (*it).get() == 40);
+      assertUnit(frozen.find(Spy(35)) == frozen.end());
+      assertUnit(frozen.find(Spy(60)) != frozen.end() && (*frozen.find(Spy(60))).get() == 60);
+      assertUnit(frozen.upper_bound(Spy(80)) == frozen.end());
+      int expected = 20;
+      for (auto itFrozen = frozen.begin(); itFrozen != frozen.end(); ++itFrozen, expected += 10)
+         assertUnit((*itFrozen).get() == expected);
+      assertUnit(expected == 90);
+      assertUnit((*--frozen.end()).get() == 80);
       assertStandardFixture(bst);
       // teardown
       teardownStandardFixture(bst);
    }
 
+   // a frozen copy answers every lookup the way the tree does
+   void test_freeze_matchesTree()
+   {  // setup
+      custom::BST <int> bst;
+      for (int i = 0; i < 1000; i++)
+         bst.insert((i * 37) % 300 * 3);          // multiples of 3 under 900, some repeated
+      // exercise
+      custom::FrozenBST <int> frozen = bst.freeze();
+      // verify
+      assertUnit(frozen.size() == 1000);
+      bool isSame = true;
+      for (int key = -2; key < 905; key++)
+      {
+         auto itLower = frozen.lower_bound(key);
+         auto itUpper = frozen.upper_bound(key);
+         auto itFind = frozen.find(key);
+         isSame = isSame && (itLower == frozen.end()) == (bst.lower_bound(key) == bst.end());
+         isSame = isSame && (itUpper == frozen.end()) == (bst.upper_bound(key) == bst.end());
+         isSame = isSame && (itFind == frozen.end()) == (bst.find(key) == bst.end());
+         if (itLower != frozen.end() && bst.lower_bound(key) != bst.end())
+            isSame = isSame && *itLower == *bst.lower_bound(key);
+         if (itUpper != frozen.end() && bst.upper_bound(key) != bst.end())
+            isSame = isSame && *itUpper == *bst.upper_bound(key);
+      }
+      assertUnit(isSame);
+      assertUnit(std::equal(frozen.begin(), frozen.end(), bst.begin()));
+      auto itBack = bst.end();
+      auto itFrozenBack = frozen.end();
+      bool isSameBack = true;
+      while (itBack != bst.begin())
+         isSameBack = isSameBack && *--itBack == *--itFrozenBack;
+      assertUnit(isSameBack);
+      assertUnit(itFrozenBack == frozen.begin());
+      assertUnit(custom::FrozenBST<int>().begin() == custom::FrozenBST<int>().end());
+   }  // teardown
+
+   // more keys than descents run side by side, with duplicates in the tree
+   void test_findBatch_matchesFind()
+   {  // setup
+      custom::BST <int> bst;
+      for (int i = 0; i < 1000; i++)
+         bst.insert((i * 37) % 500 * 2);          // even numbers under 1000, twice each
+      std::vector<int> keys;
+      for (int i = -5; i < 1005; i++)
+         keys.push_back(i);
+      std::vector<custom::BST<int>::iterator> results(keys.size());
+      // exercise
+      auto itEnd = bst.find_batch(keys.begin(), keys.end(), results.begin());
+      // verify
+      assertUnit(itEnd == results.end());
+      bool isSame = true;
+      for (size_t i = 0; i < keys.size(); i++)
+         isSame = isSame && results[i] == bst.find(keys[i]);
+      assertUnit(isSame);
+      assertUnit(results[5] != bst.end() && *results[5] == 0);
+      assertUnit(results[6] == bst.end());
+   }  // teardown
+
+   /***************************************
+    * Transparent lookup
+    *    BST::find(const K &)
+    *    BST::count(const K &)
+    *    BST::erase(const K &)
+    ***************************************/
+
+   // look records up by id without building a record
+   void test_find_transparentKey()
+   {  // setup
+      custom::BST <Record, RecordById> bst;
+      for (unsigned long long id : { 50ull, 30ull, 70ull, 20ull, 40ull, 60ull, 80ull })
+         bst.insert(Record(id));
+      Record::numConstruct = 0;
+      // exercise
+      auto itFound   = bst.find(40ull);
+      auto itMissing = bst.find(45ull);
+      auto itLower   = bst.lower_bound(45ull);
+      size_t num     = bst.count(60ull);
+      // verify
+      assertUnit(Record::numConstruct == 0);
+      assertUnit(itFound != bst.end() && (*itFound).id == 40);
+      assertUnit(itMissing == bst.end());
+      assertUnit(itLower != bst.end() && (*itLower).id == 50);
+      assertUnit(num == 1);
+      assertUnit(bst.count(Record(60)) == 1);
+   }  // teardown
+
+   // erase every element with a key, by key
+   void test_erase_transparentKey()
+   {  // setup
+      custom::BST <Record, RecordById> bst;
+      for (unsigned long long id : { 5ull, 3ull, 5ull, 7ull, 5ull })
+         bst.insert(Record(id));
+      Record::numConstruct = 0;
+      // exercise
+      size_t numErased = bst.erase(5ull);
+      size_t numMissing = bst.erase(4ull);
+      // verify
+      assertUnit(Record::numConstruct == 0);
+      assertUnit(numErased == 3);
+      assertUnit(numMissing == 0);
+      assertUnit(bst.size() == 2);
+      assertUnit(bst.count(5ull) == 0);
+      assertUnit(blackHeight(bst.root) > 0);
+   }  // teardown
+
+   /***************************************
+    * Order statistics
+    *    BST::select(size_t)
+    *    BST::rank(const T &)
+    *    BST::advance(iterator, ptrdiff_t)
+    ***************************************/
+
+   // subtree sizes survive the rotations of insert and erase
+   void test_select_afterInsertErase()
+   {  // setup
+      typedef custom::BST<int, std::less<int>, std::allocator<int>, true> BSTCounted;
+      BSTCounted bst;
+      for (int i = 0; i < 100; i++)
+         bst.insert((i * 37) % 100);     // 0..99 scrambled
+      for (int i = 0; i < 100; i += 2)
+      {
+         auto it = bst.find(i);
+         bst.erase(it);                  // leaves 1, 3, 5, ... 99
+      }
+      // exercise
+      auto itFirst  = bst.select(0);
+      auto itMiddle = bst.select(25);
+      auto itLast   = bst.select(49);
+      auto itPast   = bst.select(50);
+      // verify
+      assertUnit(itFirst  != bst.end() && *itFirst  == 1);
+      assertUnit(itMiddle != bst.end() && *itMiddle == 51);
+      assertUnit(itLast   != bst.end() && *itLast   == 99);
+      assertUnit(itPast   == bst.end());
+      assertUnit(bst.root != nullptr && bst.root->getCount() == 50);
+      // an ordinary BST does not pay for the count
+      struct Uncounted { int data; void* pLeft; void* pRight; void* pParent; bool isRed; };
+      assertUnit(sizeof(custom::BST<int>::BNode) == sizeof(Uncounted));
+   }  // teardown
+
+   // rank counts everything strictly less, one comparison per level
+   void test_rank_duplicates()
+   {  // setup
+      typedef custom::BST<int, std::less<int>, std::allocator<int>, true> BSTCounted;
+      BSTCounted bst;
+      for (int i : { 50, 30, 70, 30, 20, 40, 60, 80, 30 })
+         bst.insert(i);
+      // exercise and verify
+      assertUnit(bst.rank(10) == 0);
+      assertUnit(bst.rank(20) == 0);
+      assertUnit(bst.rank(30) == 1);
+      assertUnit(bst.rank(35) == 4);
+      assertUnit(bst.rank(80) == 8);
+      assertUnit(bst.rank(99) == 9);
+      assertUnit(bst.select(bst.rank(40)) == bst.find(40));
+   }  // teardown
 
+   // advance jumps by rank in either direction
+   void test_advance_bothWays()
+   {  // setup
+      typedef custom::BST<int, std::less<int>, std::allocator<int>, true> BSTCounted;
+      BSTCounted bst;
+      for (int i = 1; i <= 1000; i++)
+         bst.insert(i);
+      // exercise
+      auto it     = bst.advance(bst.begin(), 499);
+      auto itBack = bst.advance(it, -400);
+      auto itEnd  = bst.advance(it, 501);
+      auto itLast = bst.advance(bst.end(), -1);
+      // verify
+      assertUnit(it     != bst.end() && *it     == 500);
+      assertUnit(itBack != bst.end() && *itBack == 100);
+      assertUnit(itEnd  == bst.end());
+      assertUnit(itLast != bst.end() && *itLast == 1000);
+      assertUnit(bst.advance(bst.begin(), -1) == bst.end());
+   }  // teardown
 
    /***************************************
     * Insert
@@ -1857,8 +3425,8 @@ public:
       // exercise
       auto pairBST = bst.insert(s, true /* keepUnique */);
       // verify
-      assertUnit(Spy::numLessthan() == 2);    // compare [50][30]
-      assertUnit(Spy::numEquals() == 3);      // compare [50][30][40]
+      assertUnit(Spy::numLessthan() == 4);    // compare [50][30][40] then check [40]
+      assertUnit(Spy::numEquals() == 0);
       assertUnit(Spy::numCopy() == 0);
       assertUnit(Spy::numAlloc() == 0);
       assertUnit(Spy::numDestructor() == 0);
@@ -1885,6 +3453,113 @@ public:
 
 
 
+   // insert an element into an empty BST
+   void test_insert_empty()
+   {  // setup
+      custom::BST <Spy> bst;
+      Spy s(50);
+      Spy::reset();
+      // exercise
+      auto pairBST = bst.insert(s);
+      // verify
+      assertUnit(Spy::numCopy() == 1);        // copy-create [50]
+      assertUnit(Spy::numAlloc() == 1);       // allocate [50]
+      assertUnit(Spy::numLessthan() == 0);
+      assertUnit(Spy::numEquals() == 0);
+      assertUnit(Spy::numDestructor() == 0);
+      assertUnit(Spy::numDelete() == 0);
+      assertUnit(Spy::numAssign() == 0);
+      assertUnit(Spy::numDefault() == 0);
+      assertUnit(Spy::numNondefault() == 0);
+      assertUnit(Spy::numCopyMove() == 0);
+      assertUnit(Spy::numAssignMove() == 0);
+      assertUnit(pairBST.second == true);
+      //            (50) 
+      assertUnit(bst.numElements == 1);
+      assertUnit(bst.root != nullptr);
+      if (bst.root)
+      {
+         assertUnit(pairBST.first == custom::BST<Spy>::iterator(bst.root));
+         assertUnit(bst.root->data == Spy(50));
+         assertUnit(bst.root->pLeft == nullptr);
+         assertUnit(bst.root->pRight == nullptr);
+         assertUnit(bst.root->pParent == nullptr);
+      }
+   }  // teardown
+
+   // insert an element below the bottom row of the standard fixture
+   void test_insert_standardLeaf()
+   {  // setup
+      //                 50 
+      //          +-------+-------+
+      //         30              70  
+      //     +----+----+     +----+----+
+      //    20        40    60        80  
+      custom::BST <Spy> bst;
+      setupStandardFixture(bst);
+      custom::BST<Spy>::BNode* p40 = bst.root->pLeft->pRight;
+      Spy s(45);
+      Spy::reset();
+      // exercise
+      auto pairBST = bst.insert(s, true /* keepUnique */);
+      // verify
+      assertUnit(Spy::numLessthan() == 4);    // compare [50][30][40] then check [40]
+      assertUnit(Spy::numCopy() == 1);        // copy-create [45]
+      assertUnit(Spy::numAlloc() == 1);       // allocate [45]
+      assertUnit(Spy::numEquals() == 0);
+      assertUnit(Spy::numDestructor() == 0);
+      assertUnit(Spy::numDelete() == 0);
+      assertUnit(Spy::numAssign() == 0);
+      assertUnit(Spy::numDefault() == 0);
+      assertUnit(Spy::numNondefault() == 0);
+      assertUnit(Spy::numCopyMove() == 0);
+      assertUnit(Spy::numAssignMove() == 0);
+      assertUnit(pairBST.second == true);
+      //                 50 
+      //          +-------+-------+
+      //         30              70  
+      //     +----+----+     +----+----+
+      //    20        40    60        80  
+      //               +--+
+      //                 [45]
+      assertUnit(bst.numElements == 8);
+      assertUnit(blackHeight(bst.root) > 0);
+      assertUnit(p40->pLeft == nullptr);
+      assertUnit(p40->pRight != nullptr);
+      if (p40->pRight)
+      {
+         assertUnit(pairBST.first == custom::BST<Spy>::iterator(p40->pRight));
+         assertUnit(p40->pRight->data == Spy(45));
+         assertUnit(p40->pRight->pParent == p40);
+         assertUnit(p40->pRight->pLeft == nullptr);
+         assertUnit(p40->pRight->pRight == nullptr);
+         delete p40->pRight;
+         p40->pRight = nullptr;
+      }
+      bst.numElements = 7;
+      assertStandardFixture(bst);
+      // teardown
+      teardownStandardFixture(bst);
+   }
+
+   // insert a sorted sequence, which would make a linked list without balancing
+   void test_insert_sortedBalanced()
+   {  // setup
+      custom::BST <int> bst;
+      // exercise
+      for (int i = 1; i <= 1023; i++)
+         bst.insert(i);
+      // verify
+      assertUnit(bst.numElements == 1023);
+      assertUnit(blackHeight(bst.root) > 0);
+      assertUnit(height(bst.root) <= 20);     // 2 log2(1024)
+      assertUnit(bst.root != nullptr && bst.root->isRed == false);
+      int expected = 1;
+      for (auto it = bst.begin(); it != bst.end(); ++it)
+         assertUnit(*it == expected++);
+      assertUnit(expected == 1024);
+   }  // teardown
+
    /***************************************
     * Insert Move
     *    BST::insert(T &&)
@@ -2089,8 +3764,8 @@ public:
       // exercise
       auto pairBST = bst.insert(std::move(s), true /* keepUnique */);
       // verify
-      assertUnit(Spy::numLessthan() == 2);    // compare [50][30]
-      assertUnit(Spy::numEquals() == 3);      // compare [50][30][40]
+      assertUnit(Spy::numLessthan() == 4);    // compare [50][30][40] then check [40]
+      assertUnit(Spy::numEquals() == 0);
       assertUnit(Spy::numCopy() == 0);
       assertUnit(Spy::numAlloc() == 0);
       assertUnit(Spy::numDestructor() == 0);
@@ -2116,6 +3791,229 @@ public:
    }
 
 
+   /***************************************
+    * Emplace
+    *    BST::emplace(Args &&...)
+    *    BST::emplace_unique(Args &&...)
+    ***************************************/
+
+   // build the element right inside the new node
+   void test_emplace_inPlace()
+   {  // setup
+      //                 50 
+      //          +-------+-------+
+      //         30              70  
+      //     +----+----+     +----+----+
+      //    20        40    60        80  
+      custom::BST <Spy> bst;
+      setupStandardFixture(bst);
+      Spy::reset();
+      // exercise
+      auto pairBST = bst.emplace(65);
+      // verify
+      assertUnit(Spy::numNondefault() == 1);  // create [65] in the node
+      assertUnit(Spy::numAlloc() == 1);       // allocate [65]
+      assertUnit(Spy::numLessthan() == 3);    // compare [50][70][60]
+      assertUnit(Spy::numCopy() == 0);
+      assertUnit(Spy::numCopyMove() == 0);
+      assertUnit(Spy::numAssign() == 0);
+      assertUnit(Spy::numAssignMove() == 0);
+      assertUnit(Spy::numDestructor() == 0);
+      assertUnit(Spy::numDelete() == 0);
+      assertUnit(Spy::numEquals() == 0);
+      assertUnit(pairBST.second == true);
+      //                 50 
+      //          +-------+-------+
+      //         30              70  
+      //     +----+----+     +----+----+
+      //    20        40    60        80  
+      //                     +--+
+      //                       [65]
+      assertUnit(blackHeight(bst.root) > 0);
+      custom::BST<Spy>::BNode* p60 = bst.root->pRight->pLeft;
+      assertUnit(p60->pRight != nullptr);
+      if (p60->pRight)
+      {
+         assertUnit(pairBST.first == custom::BST<Spy>::iterator(p60->pRight));
+         assertUnit(p60->pRight->data == Spy(65));
+         assertUnit(p60->pRight->pParent == p60);
+         delete p60->pRight;
+         p60->pRight = nullptr;
+      }
+      bst.numElements = 7;
+      assertStandardFixture(bst);
+      // teardown
+      teardownStandardFixture(bst);
+   }
+
+   // a rejected duplicate does not cost a node
+   void test_emplace_uniqueDuplicate()
+   {  // setup
+      typedef custom::BST<Spy, std::less<Spy>, CountingAllocator<Spy>> BSTCount;
+      typedef CountingAllocator<BSTCount::BNode> NodeCount;
+      BSTCount bst;
+      bst.emplace(50);
+      bst.emplace(30);
+      bst.emplace(70);
+      NodeCount::reset();
+      Spy::reset();
+      // exercise
+      auto pairBST = bst.emplace_unique(30);
+      // verify
+      assertUnit(NodeCount::numAllocate == 0);
+      assertUnit(NodeCount::numDeallocate == 0);
+      assertUnit(Spy::numNondefault() == 1);  // create [30] to compare with
+      assertUnit(Spy::numDestructor() == 1);  // and throw it away
+      assertUnit(Spy::numCopy() == 0);
+      assertUnit(Spy::numCopyMove() == 0);
+      assertUnit(pairBST.second == false);
+      assertUnit(pairBST.first != bst.end());
+      if (pairBST.first != bst.end())
+         assertUnit(*pairBST.first == Spy(30));
+      assertUnit(bst.numElements == 3);
+   }  // teardown
+
+   /***************************************
+    * Insert with a hint
+    *    BST::insert(iterator, const T &)
+    ***************************************/
+
+   // append sorted data using end() as the hint
+   void test_insertHint_sortedEnd()
+   {  // setup
+      custom::BST <Spy> bst;
+      Spy::reset();
+      // exercise
+      for (int i = 1; i <= 1000; i++)
+         bst.insert(bst.end(), Spy(i));
+      // verify
+      assertUnit(Spy::numLessthan() == 999);  // compare with the last one only
+      assertUnit(Spy::numEquals() == 0);
+      assertUnit(bst.numElements == 1000);
+      assertUnit(blackHeight(bst.root) > 0);
+      int expected = 1;
+      for (auto it = bst.begin(); it != bst.end(); ++it)
+         assertUnit(*it == Spy(expected++));
+   }  // teardown
+
+   // append sorted data using the last insertion as the hint
+   void test_insertHint_sortedLast()
+   {  // setup
+      custom::BST <Spy> bst;
+      custom::BST <Spy>::iterator it = bst.end();
+      Spy::reset();
+      // exercise
+      for (int i = 1; i <= 1000; i++)
+         it = bst.insert(it, Spy(i));
+      // verify
+      assertUnit(Spy::numLessthan() == 999);  // compare with the hint only
+      assertUnit(Spy::numEquals() == 0);
+      assertUnit(bst.numElements == 1000);
+      assertUnit(blackHeight(bst.root) > 0);
+      int expected = 1;
+      for (auto it = bst.begin(); it != bst.end(); ++it)
+         assertUnit(*it == Spy(expected++));
+   }  // teardown
+
+   // a hint that is nowhere near still puts the element in the right place
+   void test_insertHint_wrongHint()
+   {  // setup
+      //                 50 
+      //          +-------+-------+
+      //         30              70  
+      //     +----+----+     +----+----+
+      //    20        40    60        80  
+      custom::BST <Spy> bst;
+      setupStandardFixture(bst);
+      auto itHint = custom::BST<Spy>::iterator(bst.root->pRight->pRight);
+      Spy s(35);
+      Spy::reset();
+      // exercise
+      auto it = bst.insert(itHint, s);
+      // verify
+      assertUnit(Spy::numCopy() == 1);        // copy-create [35]
+      assertUnit(Spy::numLessthan() == 5);    // hint [80][70] then [50][30][40]
+      //                 50 
+      //          +-------+-------+
+      //         30              70  
+      //     +----+----+     +----+----+
+      //    20        40    60        80  
+      //            +--+
+      //          [35]
+      assertUnit(blackHeight(bst.root) > 0);
+      custom::BST<Spy>::BNode* p40 = bst.root->pLeft->pRight;
+      assertUnit(p40->pLeft != nullptr);
+      if (p40->pLeft)
+      {
+         assertUnit(it == custom::BST<Spy>::iterator(p40->pLeft));
+         assertUnit(p40->pLeft->data == Spy(35));
+         assertUnit(p40->pLeft->pParent == p40);
+         delete p40->pLeft;
+         p40->pLeft = nullptr;
+      }
+      bst.numElements = 7;
+      assertStandardFixture(bst);
+      // teardown
+      teardownStandardFixture(bst);
+   }
+
+   // a batch goes in with one copy each and the tree stays balanced
+   void test_insertRange_batch()
+   {  // setup
+      custom::BST <Spy> bst;
+      for (int i = 1; i < 1000; i += 2)
+         bst.insert(Spy(i));                      // the 500 odd numbers
+      std::vector<Spy> batch;
+      for (int i = 0; i < 100; i++)
+         batch.push_back(Spy(2 + (i * 37) % 100 * 2));  // 2 through 200, shuffled
+      batch.push_back(Spy(501));                  // one duplicate
+      Spy::reset();
+      // exercise
+      bst.insert(batch.begin(), batch.end());
+      // verify
+      assertUnit(Spy::numCopy() == 101);
+      assertUnit(Spy::numAssign() == 0);
+      assertUnit(bst.size() == 601);
+      assertUnit(bst.count(Spy(501)) == 2);
+      assertUnit(blackHeight(bst.root) > 0);
+      assertUnit(bst.root->pParent == nullptr);
+      int previous = 0;
+      for (auto it = bst.begin(); it != bst.end(); ++it)
+      {
+         assertUnit((*it).get() >= previous);
+         previous = (*it).get();
+      }
+      assertUnit((*--bst.end()).get() == 999);
+   }  // teardown
+
+   // keepUnique turns away duplicates from the tree and from the batch
+   void test_insertRange_keepUnique()
+   {  // setup
+      typedef custom::BST<int, std::less<int>, CountingAllocator<int>> BSTCount;
+      typedef CountingAllocator<BSTCount::BNode> NodeCount;
+      BSTCount bst;
+      for (int i : { 50, 30, 70, 20, 40, 60, 80 })
+         bst.insert(i);
+      std::vector<int> batch { 35, 40, 35, 65, 80, 85, 10 };
+      NodeCount::reset();
+      // exercise
+      bst.insert(batch.begin(), batch.end(), true /*keepUnique*/);
+      // verify
+      assertUnit(NodeCount::numAllocate == 7);
+      assertUnit(NodeCount::numDeallocate == 3);  // 40, 80 and the second 35
+      assertUnit(bst.size() == 11);
+      assertUnit(bst.count(35) == 1 && bst.count(40) == 1 && bst.count(80) == 1);
+      assertUnit(bst.count(10) == 1 && bst.count(65) == 1 && bst.count(85) == 1);
+      assertUnit(blackHeight(bst.root) > 0);
+      assertUnit(*bst.begin() == 10);
+      int previous = 0;
+      for (auto it = bst.begin(); it != bst.end(); ++it)
+      {
+         assertUnit(*it > previous);
+         previous = *it;
+      }
+   }  // teardown
+
    /***************************************
     * Erase
     *    BST::erase(it)
@@ -2211,6 +4109,7 @@ public:
       assertUnit(itReturn == custom::BST <Spy> ::iterator(bst.root->pRight));
       assertUnit(bst.root->pRight->pLeft == nullptr);
       assertUnit(bst.numElements == 6);
+      assertUnit(blackHeight(bst.root) > 0);
       bst.root->pRight->pLeft = new custom::BST<Spy>::BNode(Spy(60));
       bst.root->pRight->pLeft->pParent = bst.root->pRight;
       bst.numElements = 7;
@@ -2351,8 +4250,72 @@ public:
       bst.root = nullptr;
    }
 
+   // erase every other element from a balanced tree
+   void test_erase_keepsBalanced()
+   {  // setup
+      custom::BST <int> bst;
+      for (int i = 1; i <= 1000; i++)
+         bst.insert(i);
+      // exercise
+      for (int i = 2; i <= 1000; i += 2)
+      {
+         auto it = bst.find(i);
+         auto itNext = bst.erase(it);
+         if (i < 1000)
+            assertUnit(itNext != bst.end() && *itNext == i + 1);
+      }
+      // verify
+      assertUnit(bst.numElements == 500);
+      assertUnit(blackHeight(bst.root) > 0);
+      assertUnit(height(bst.root) <= 18);     // 2 log2(512)
+      int expected = 1;
+      for (auto it = bst.begin(); it != bst.end(); ++it, expected += 2)
+         assertUnit(*it == expected);
+      assertUnit(expected == 1001);
+   }  // teardown
+
+   /**************************************************************
+    * BLACK HEIGHT
+    * Number of black nodes on every path down from pNode, or -1
+    * if the red-black rules or the parent pointers are broken
+    *************************************************************/
+   template <class BNode>
+   int blackHeight(const BNode* pNode)
+   {
+      if (pNode == nullptr)
+         return 1;
+      if (pNode->pLeft && pNode->pLeft->pParent != pNode)
+         return -1;
+      if (pNode->pRight && pNode->pRight->pParent != pNode)
+         return -1;
+      if (pNode->isRed && ((pNode->pLeft && pNode->pLeft->isRed) ||
+                           (pNode->pRight && pNode->pRight->isRed)))
+         return -1;
+      int left  = blackHeight(pNode->pLeft);
+      int right = blackHeight(pNode->pRight);
+      if (left < 0 || left != right)
+         return -1;
+      return left + (pNode->isRed ? 0 : 1);
+   }
+
+   /**************************************************************
+    * HEIGHT
+    * Number of nodes on the longest path down from pNode
+    *************************************************************/
+   template <class BNode>
+   int height(const BNode* pNode)
+   {
+      if (pNode == nullptr)
+         return 0;
+      int left  = height(pNode->pLeft);
+      int right = height(pNode->pRight);
+      return 1 + (left > right ? left : right);
+   }
+
    /**************************************************************
     * SETUP STANDARD FIXTURE
+    * A valid red-black tree: the top two rows are black
+    * and the bottom row is red
     *                (50) 
     *          +-------+-------+
     *        (30)            (70) 
@@ -2387,8 +4350,13 @@ public:
       p30->pParent = p70->pParent = p50;
       p60->pParent = p80->pParent = p70;
 
+      // color it
+      p50->isRed = p30->isRed = p70->isRed = false;
+
       // now assign everything to the bst
       bst.root = p50;
+      bst.pFirst = p20;
+      bst.pLast = p80;
       bst.numElements = 7;
    }
 
@@ -2414,6 +4382,7 @@ public:
       // verify the member variables
       assertIndirect(bst.numElements == 7);
       assertIndirect(bst.root != nullptr);
+      assertIndirect(blackHeight(bst.root) > 0);
 
       // verify the pointers down
       assertIndirect(bst.root != nullptr);
@@ -2500,7 +4469,7 @@ public:
          }
          delete bst.root;
       }
-      bst.root = nullptr;
+      bst.root = bst.pFirst = bst.pLast = nullptr;
       bst.numElements = 0;
    }
 